@@ -6,28 +6,138 @@
 
 #include "multithreading.h"
 #include "verbosity.h"
+#include <errno.h>
+
+static _Thread_local long blocked_ns = 0; // Time the current thread spent in waitForTask, excluded from the efficiency of its task
+
+static long elapsedNs(const struct timespec* start, const struct timespec* end) {
+    return (long)(end->tv_sec - start->tv_sec) * 1000000000L + (end->tv_nsec - start->tv_nsec);
+}
+
+// Take the task at the front of the queue, the queue mutex must be held and a task must be queued
+static Task* takeTask(TaskQueue* queue) {
+    Task* task = queue->tasks[queue->front];
+    queue->tasks[queue->front] = NULL; // The task may live on its caller's stack, so do not keep a stale pointer to it
+    queue->front = (queue->front + 1) % queue->size; // Update the front of the queue
+    queue->no_queued_tasks--;
+    return task;
+}
+
+// Account the run time of a finished task, the queue mutex must be held
+static void recordTaskTime(ThreadPool* pool, long cpu_ns, long wall_ns) {
+    pool->window_cpu_ns += cpu_ns;
+    pool->window_wall_ns += wall_ns;
+    if (pool->window_wall_ns >= POOL_EFFICIENCY_WINDOW_MS * 1000000L) {
+        pool->efficiency = (double)pool->window_cpu_ns / (double)pool->window_wall_ns;
+        clock_gettime(CLOCK_MONOTONIC, &pool->efficiency_time);
+        print_verbosity(DEBUG, "{recordTaskTime}: Efficiency %.2f with %d threads", pool->efficiency, pool->no_threads);
+        pool->window_cpu_ns = 0;
+        pool->window_wall_ns = 0;
+    }
+}
+
+// Whether a recent measurement found the host too busy for the pool's threads, the queue mutex must be held.
+// Only tasks that run on the pool refresh the efficiency, so a stale low value must not keep the pool small for good
+static bool isPoolOversubscribed(ThreadPool* pool) {
+    if (pool->efficiency >= pool->min_efficiency) {
+        return false;
+    }
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    if (elapsedNs(&pool->efficiency_time, &now) < POOL_EFFICIENCY_TTL_MS * 1000000L) {
+        return true;
+    }
+    pool->efficiency = 1.0; // Measure again from scratch
+    pool->window_cpu_ns = 0;
+    pool->window_wall_ns = 0;
+    return false;
+}
+
+// Start one more worker, the queue mutex must be held. Returns -1 when the pool may not grow
+static int growPool(ThreadPool* pool) {
+    if (pool->terminated || pool->no_threads >= pool->max_threads) {
+        return -1;
+    }
+    // The pool keeps at least one worker, whatever the efficiency, otherwise it could never measure it again
+    if (pool->no_threads >= 1 && pool->no_threads >= pool->min_threads && isPoolOversubscribed(pool)) {
+        return -1;
+    }
+    for (int i = 0; i < pool->max_threads; i++) {
+        WorkerSlot* slot = &pool->workers[i];
+        if (slot->state == SLOT_RUNNING) {
+            continue;
+        }
+        if (slot->state == SLOT_EXITED) {
+            pthread_join(slot->thread, NULL); // The thread has already released the queue mutex for good
+            slot->state = SLOT_FREE;
+        }
+        if (pthread_create(&(slot->thread), NULL, worker, slot) != 0) {
+            return -1;
+        }
+        slot->state = SLOT_RUNNING;
+        pool->no_threads++;
+        print_verbosity(DEBUG, "{growPool}: Started worker %d, %d threads", i, pool->no_threads);
+        return 0;
+    }
+    return -1;
+}
+
+// Tell the listeners a slot of the pool is free, no pool lock may be held since they may call addTaskFront
+static void notifyListeners(ThreadPool* pool) {
+    pthread_mutex_lock(&(pool->listeners_mutex));
+    for (PoolListener* listener = pool->listeners; listener != NULL; listener = listener->next) {
+        listener->function(listener->arg);
+    }
+    pthread_mutex_unlock(&(pool->listeners_mutex));
+}
 
 void* worker(void* args) {
-    ThreadPool* pool = (ThreadPool*)args;
+    WorkerSlot* slot = (WorkerSlot*)args;
+    ThreadPool* pool = slot->pool;
 
     while (1) {
 //        print_verbosity(DEBUG, "{worker - thread %ld}: Acquiring lock for queue: %p", pthread_self(), &pool->queue);
         pthread_mutex_lock(&(pool->queue.mutex));
 //        print_verbosity(DEBUG, "{worker - thread %ld}: Acquired lock for queue: %p", pthread_self(), &pool->queue);
         print_verbosity(DEBUG, "{worker - thread %ld}: number of active tasks: %d", pthread_self(), pool->queue.no_active_tasks);
-        while (pool->queue.front==pool->queue.rear && !pool->terminated) { // Needs to be changed, because active tasks are not the same as taken up tasks
+        bool retire = false;
+        while (pool->queue.no_queued_tasks == 0 && !pool->terminated) {
+            // The extra threads are not paying off. The last worker stays until it times out, since growPool
+            // would start a new one for the next task anyway
+            if (pool->no_threads > pool->min_threads && pool->no_threads > 1 && isPoolOversubscribed(pool)) {
+                retire = true;
+                break;
+            }
             print_verbosity(DEBUG, "{worker - thread %ld}: Waiting for new tasks in queue: %p",  pthread_self(), pool->queue.no_active_tasks, &pool->queue);
-            pthread_cond_wait(&(pool->queue.cond), &(pool->queue.mutex));
+            struct timespec deadline;
+            clock_gettime(CLOCK_MONOTONIC, &deadline);
+            deadline.tv_sec += pool->idle_timeout_ms / 1000;
+            deadline.tv_nsec += (pool->idle_timeout_ms % 1000) * 1000000L;
+            if (deadline.tv_nsec >= 1000000000L) {
+                deadline.tv_sec++;
+                deadline.tv_nsec -= 1000000000L;
+            }
+            int status = pthread_cond_timedwait(&(pool->queue.cond), &(pool->queue.mutex), &deadline);
+            if (status == ETIMEDOUT && pool->queue.no_queued_tasks == 0 && pool->no_threads > pool->min_threads) {
+                retire = true; // Idle for too long
+                break;
+            }
         }
         if (pool->terminated) {
             print_verbosity(DEBUG, "{worker - thread %ld}: Terminating queue: %p", pthread_self(), &pool->queue);
             pthread_mutex_unlock(&(pool->queue.mutex));
             break;
         }
+        if (retire) {
+            // The queue is empty and this worker runs no task, so every active task keeps a thread
+            pool->no_threads--;
+            slot->state = SLOT_EXITED;
+            print_verbosity(DEBUG, "{worker - thread %ld}: Retiring, %d threads left", pthread_self(), pool->no_threads);
+            pthread_mutex_unlock(&(pool->queue.mutex));
+            break;
+        }
 
-        Task* task = (pool->queue.tasks[pool->queue.front]); // Assign the task at the front of the queue to the worker
-
-        pool->queue.front = (pool->queue.front + 1) % pool->queue.max_tasks; // Update the front of the queue
+        Task* task = takeTask(&pool->queue); // Assign the next task to the worker
 
         print_verbosity(DEBUG, "{worker - thread %ld}: Starting task %p in queue: %p thread %ld", task, &pool->queue, pthread_self());
 //        print_verbosity(DEBUG, "{worker - thread %ld}: Releasing lock for queue: %p", pthread_self(), &pool->queue);
@@ -39,21 +149,57 @@ void* worker(void* args) {
         pthread_mutex_lock(&(task->mutex));
 //        print_verbosity(DEBUG, "{worker - thread %ld}: Acquired lock for task: %p at address %p", pthread_self(), task, (void*)&(task->mutex));
 
-        task->output = task->function(task->args);
+        bool elastic = pool->min_threads < pool->max_threads; // Fixed size pools do not measure their efficiency
+        struct timespec cpu_start, cpu_end, wall_start, wall_end;
+        if (elastic) {
+            clock_gettime(CLOCK_THREAD_CPUTIME_ID, &cpu_start);
+            clock_gettime(CLOCK_MONOTONIC, &wall_start);
+            blocked_ns = 0;
+        }
+        if (checkJobCancelled(task->job)) {
+            print_verbosity(DEBUG, "{worker - thread %ld}: Skipping task %p of cancelled job %p", pthread_self(), task, task->job);
+            task->output = NULL;
+        } else {
+            task->output = task->function(task->args);
+        }
+        if (elastic) {
+            clock_gettime(CLOCK_THREAD_CPUTIME_ID, &cpu_end);
+            clock_gettime(CLOCK_MONOTONIC, &wall_end);
+        }
         task->is_done = true;
+        pthread_mutex_lock(&(pool->queue.mutex)); // The counter is shared with addTaskFront, so it is protected by the queue mutex
         pool->queue.no_active_tasks--;
+        if (elastic) {
+            recordTaskTime(pool, elapsedNs(&cpu_start, &cpu_end), elapsedNs(&wall_start, &wall_end) - blocked_ns);
+        }
+        pthread_mutex_unlock(&(pool->queue.mutex));
+        if (atomic_load_explicit(&pool->no_listeners, memory_order_relaxed) > 0) {
+            notifyListeners(pool);
+        }
         pthread_cond_broadcast(&(task->cond));
         print_verbosity(DEBUG, "{worker - thread %ld}: Task %p is done in queue: %p thread %ld", pthread_self(), task, &pool->queue, pthread_self());
+        void (*on_done)(Task*) = task->on_done; // A waiter may release the task as soon as the mutex is unlocked
 
 //        print_verbosity(DEBUG, "{worker - thread %ld}: Releasing lock for task: %p at address %p", pthread_self(), task, (void*)&(task->mutex));
         pthread_mutex_unlock(&(task->mutex));
 //        print_verbosity(DEBUG, "{worker - thread %ld}: Released lock for task: %p at address %p", pthread_self(), task, (void*)&(task->mutex));
+        if (on_done != NULL) {
+            on_done(task);
+        }
     }
     return NULL;
 }
 
 ThreadPool* createThreadPool(int max_threads, int max_tasks) {
-    print_verbosity(NORMAL, "Creating thread pool with %d threads and %d tasks", max_threads, max_tasks);
+    return createElasticThreadPool(max_threads, max_threads, max_tasks);
+}
+
+ThreadPool* createElasticThreadPool(int min_threads, int max_threads, int max_tasks) {
+    print_verbosity(NORMAL, "Creating thread pool with %d to %d threads and %d tasks", min_threads, max_threads, max_tasks);
+    if (min_threads < 0 || min_threads > max_threads) {
+        fprintf(stderr, "Invalid thread pool size %d to %d\n", min_threads, max_threads);
+        return NULL;
+    }
     ThreadPool* pool = (ThreadPool*)malloc(sizeof(ThreadPool));
 
     if (pool == NULL) {
@@ -61,48 +207,65 @@ ThreadPool* createThreadPool(int max_threads, int max_tasks) {
         return NULL;
     }
 
-    pool->threads = (pthread_t*)malloc(max_threads * sizeof(pthread_t));
-    if (pool->threads == NULL) {
+    pool->workers = (WorkerSlot*)calloc(max_threads, sizeof(WorkerSlot)); // Every slot starts as SLOT_FREE
+    if (pool->workers == NULL) {
         fprintf(stderr, "Failed to allocate memory for threads\n");
         free(pool);
         return NULL;
     }
     pool->terminated = false;
     pool->queue.max_tasks = max_tasks;
-    pool->queue.tasks = (Task**)malloc(pool->queue.max_tasks * sizeof(Task));
+    pool->queue.size = max_tasks + 1; // One slot stays free, so that a full ring is not mistaken for an empty one (front==rear)
+    // Initialize the tasks in the queue to NULL, to avoid mispointers
+    pool->queue.tasks = (Task**)calloc(pool->queue.size, sizeof(Task*));
     if (pool->queue.tasks == NULL) {
         fprintf(stderr, "Failed to allocate memory for tasks\n");
-        free(pool->threads);
+        free(pool->workers);
         free(pool);
         return NULL;
     }
-
-    // Initialize the tasks in the queue to NULL, to avoid mispointers
-    for (int i = 0; i < pool->queue.max_tasks; i++) {
-        pool->queue.tasks[i] = NULL;
-    }
-
-    pool->max_threads = max_threads;
     pool->queue.front = 0;
     pool->queue.rear = 0;
+
+    pool->max_threads = max_threads;
+    pool->min_threads = min_threads;
+    pool->no_threads = 0;
+    pool->idle_timeout_ms = POOL_IDLE_TIMEOUT_MS;
+    pool->min_efficiency = POOL_MIN_EFFICIENCY;
+    pool->window_cpu_ns = 0;
+    pool->window_wall_ns = 0;
+    pool->efficiency = 1.0;
+    clock_gettime(CLOCK_MONOTONIC, &pool->efficiency_time);
+    for (int i = 0; i < max_threads; i++) {
+        pool->workers[i].pool = pool;
+    }
+    pool->queue.no_queued_tasks = 0;
+    pool->queue.no_active_tasks = 0;
+    pool->listeners = NULL;
+    atomic_init(&pool->no_listeners, 0);
+    pthread_mutex_init(&(pool->listeners_mutex), NULL);
     pthread_mutex_init(&(pool->queue.mutex), NULL);
-    pthread_cond_init(&(pool->queue.cond), NULL);
+    // Idle workers time out against the monotonic clock
+    pthread_condattr_t cond_attr;
+    pthread_condattr_init(&cond_attr);
+    pthread_condattr_setclock(&cond_attr, CLOCK_MONOTONIC);
+    pthread_cond_init(&(pool->queue.cond), &cond_attr);
+    pthread_condattr_destroy(&cond_attr);
 
     pthread_mutex_lock(&(pool->queue.mutex));
     print_verbosity(NORMAL, "Thread pool created", max_threads, max_tasks);
     // print tasks
-    for (int i = 0; i < pool->queue.max_tasks; i++) {
+    for (int i = 0; i < pool->queue.size; i++) {
         if (pool->queue.tasks[i] != NULL) {
             print_verbosity(DEBUG, "Task %d: %p - Done: %d", i, pool->queue.tasks[i], pool->queue.tasks[i]->is_done);
         } else {
             print_verbosity(DEBUG, "Task %d: %p - NULL", i, pool->queue.tasks[i]);
         }
     }
-    pthread_mutex_unlock(&(pool->queue.mutex));
-
-    for (int i = 0; i < max_threads; i++) {
-        pthread_create(&(pool->threads[i]), NULL, worker, pool);
+    for (int i = 0; i < min_threads; i++) {
+        growPool(pool);
     }
+    pthread_mutex_unlock(&(pool->queue.mutex));
 
     return pool;
 }
@@ -110,21 +273,36 @@ ThreadPool* createThreadPool(int max_threads, int max_tasks) {
 void destroyThreadPool(ThreadPool* pool) {
     print_verbosity(NORMAL, "Destroying thread pool");
 
+    WorkerState* states = (WorkerState*)malloc(pool->max_threads * sizeof(WorkerState));
+    if (states == NULL) {
+        fprintf(stderr, "Failed to allocate memory for worker states\n");
+        exit(EXIT_FAILURE);
+    }
+
+    // No worker starts once terminated is set, so the slots in use can be read once
     pthread_mutex_lock(&(pool->queue.mutex));
     pool->terminated = true;
+    for (int i = 0; i < pool->max_threads; i++) {
+        states[i] = pool->workers[i].state;
+    }
     pthread_cond_broadcast(&(pool->queue.cond));
     pthread_mutex_unlock(&(pool->queue.mutex));
 
+    // Workers leave their loop once they see the terminated flag, retired workers have already left it
     for (int i = 0; i < pool->max_threads; i++) {
-        pthread_cancel(pool->threads[i]);
-        pthread_join(pool->threads[i], NULL);
-        print_verbosity(NORMAL, "thread %ld joined and destroyed", i);
+        if (states[i] != SLOT_FREE) {
+            pthread_join(pool->workers[i].thread, NULL);
+            print_verbosity(NORMAL, "thread %ld joined and destroyed", i);
+        }
     }
+    free(states);
 
     pthread_mutex_destroy(&(pool->queue.mutex));
     pthread_cond_destroy(&(pool->queue.cond));
+    pthread_mutex_destroy(&(pool->listeners_mutex));
 
-    free(pool->threads);
+    free(pool->queue.tasks);
+    free(pool->workers);
     free(pool);
 }
 
@@ -134,13 +312,32 @@ int addTaskFront(ThreadPool* pool, Task* task) {
     print_verbosity(DEBUG, "{addTaskFront - thread %ld}: Adding task %p to queue: %p", pthread_self(), task, &pool->queue);
     pthread_mutex_lock(&(pool->queue.mutex));
 
-    if (pool->queue.no_active_tasks >= pool->queue.max_tasks) {
-        print_verbosity(DEBUG, "{addTaskFront - thread %ld}: Queue is full", pthread_self());
+    if (task == NULL || task->function == NULL) {
+        print_verbosity(DEBUG, "{addTaskFront - thread %ld}: Trying to add null task: %p. Aborting...", pthread_self(), task);
         pthread_mutex_unlock(&(pool->queue.mutex));
         return -1;
     }
-    if (task == NULL || task->function == NULL) {
-        print_verbosity(DEBUG, "{addTaskFront - thread %ld}: Trying to add null task: %p. Aborting...", pthread_self(), task);
+
+    // Lower priorities leave POOL_RESERVED_TASKS slots free for priority 0, so that
+    // batch work occupying the whole pool cannot turn a latency critical task away.
+    // This is the only effect of the priority, an admitted task starts right away
+    int max_active = pool->queue.max_tasks;
+    if (task->priority > 0) {
+        max_active -= POOL_RESERVED_TASKS;
+        if (max_active < 1) {
+            max_active = 1;
+        }
+    }
+    if (pool->terminated || pool->queue.no_active_tasks >= max_active) {
+        print_verbosity(DEBUG, "{addTaskFront - thread %ld}: Queue is full for priority %d", pthread_self(), task->priority);
+        pthread_mutex_unlock(&(pool->queue.mutex));
+        return -1;
+    }
+
+    // Every active task needs a worker of its own, otherwise a queued task could wait
+    // forever behind workers that are themselves waiting for their subtasks
+    if (pool->queue.no_active_tasks >= pool->no_threads && growPool(pool) != 0) {
+        print_verbosity(DEBUG, "{addTaskFront - thread %ld}: No worker available", pthread_self());
         pthread_mutex_unlock(&(pool->queue.mutex));
         return -1;
     }
@@ -153,26 +350,24 @@ int addTaskFront(ThreadPool* pool, Task* task) {
 
     // Update the front of the queue to point to the new task
     if (pool->queue.front == 0) {
-        pool->queue.front = pool->queue.max_tasks - 1;
+        pool->queue.front = pool->queue.size - 1;
     } else {
         pool->queue.front--;
     }
 
     // Add the task at the front of the queue
     pool->queue.tasks[pool->queue.front] = task;
+    pool->queue.no_queued_tasks++;
     pool->queue.no_active_tasks++;
 
     // print tasks
-    for (int i = 0; i < pool->queue.max_tasks; i++) {
+    for (int i = 0; i < pool->queue.size; i++) {
         if (pool->queue.tasks[i] != NULL) {
             print_verbosity(DEBUG, "{addTaskFront - thread %ld}: Task %d: %p - Done: %d", pthread_self(), i, pool->queue.tasks[i], pool->queue.tasks[i]->is_done);
         } else {
             print_verbosity(DEBUG, "{addTaskFront - thread %ld}: Task %d: %p - NULL", pthread_self(), i, pool->queue.tasks[i]);
         }
     }
-    if (pool->queue.tasks[pool->queue.rear] == NULL) {
-        print_verbosity(DEBUG, "{addTaskFront - thread %ld}: Rear task %p is null", pthread_self(), pool->queue.tasks[pool->queue.rear]);
-    }
 
     pthread_cond_broadcast(&(pool->queue.cond));
     pthread_mutex_unlock(&(pool->queue.mutex));
@@ -187,14 +382,130 @@ void waitForTask(ThreadPool* pool, Task* task) {
         return;
     }
 //    print_verbosity(DEBUG, "{waitForTask - thread %ld}: Acquiring lock for task: %p at address %p", pthread_self(), task, (void*)&(task->mutex));
+    struct timespec wait_start, wait_end;
+    clock_gettime(CLOCK_MONOTONIC, &wait_start);
     pthread_mutex_lock(&(task->mutex));
 //    print_verbosity(DEBUG, "{waitForTask - thread %ld}: Acquired lock for task: %p at address %p", pthread_self(), task, (void*)&(task->mutex));
     while (!task->is_done) {
         print_verbosity(DEBUG, "{waitForTask - thread %ld}: Waiting for task: %p", pthread_self(), task);
         pthread_cond_wait(&(task->cond), &(task->mutex));
     }
+    clock_gettime(CLOCK_MONOTONIC, &wait_end);
+    blocked_ns += elapsedNs(&wait_start, &wait_end);
     print_verbosity(DEBUG, "{waitForTask - thread %ld}: Task %p is done with output: %p", pthread_self(), task, task->output);
 //    print_verbosity(DEBUG, "{waitForTask - thread %ld}: Releasing lock for task: %p at address %p", pthread_self(), task, (void*)&(task->mutex));
     pthread_mutex_unlock(&(task->mutex));
 //    print_verbosity(DEBUG, "{waitForTask - thread %ld}: Released lock for task: %p at address %p", pthread_self(), task, (void*)&(task->mutex));
 }
+
+
+/*
+ * Run a batch of independent tasks and return once all of them are done.
+ * Every task is offered to the pool first, and the ones the queue rejects are
+ * executed on the calling thread, the same fallback p_merge_sort uses for its subtasks.
+ */
+void runTasks(ThreadPool* pool, Task* tasks, int no_tasks) {
+    bool* queued = (bool*)calloc(no_tasks, sizeof(bool));
+    if (queued == NULL) {
+        fprintf(stderr, "Failed to allocate memory for task batch\n");
+        exit(EXIT_FAILURE);
+    }
+
+    if (pool != NULL) {
+        for (int i = 0; i < no_tasks; i++) {
+            queued[i] = addTaskFront(pool, &tasks[i]) == 0;
+        }
+    }
+    for (int i = 0; i < no_tasks; i++) {
+        if (!queued[i]) {
+            print_verbosity(DEBUG, "{runTasks - thread %ld}: Calling task %p on same thread", pthread_self(), &tasks[i]);
+            tasks[i].output = tasks[i].function(tasks[i].args);
+            tasks[i].is_done = true;
+        }
+    }
+    for (int i = 0; i < no_tasks; i++) {
+        if (queued[i]) {
+            waitForTask(pool, &tasks[i]);
+        }
+    }
+    free(queued);
+}
+
+void addPoolListener(ThreadPool* pool, PoolListener* listener) {
+    pthread_mutex_lock(&(pool->listeners_mutex));
+    listener->next = pool->listeners;
+    pool->listeners = listener;
+    atomic_fetch_add(&pool->no_listeners, 1);
+    pthread_mutex_unlock(&(pool->listeners_mutex));
+}
+
+// Once this returns, the listener is not running and will not run again
+void removePoolListener(ThreadPool* pool, PoolListener* listener) {
+    pthread_mutex_lock(&(pool->listeners_mutex));
+    for (PoolListener** link = &pool->listeners; *link != NULL; link = &(*link)->next) {
+        if (*link == listener) {
+            *link = listener->next;
+            atomic_fetch_sub(&pool->no_listeners, 1);
+            break;
+        }
+    }
+    pthread_mutex_unlock(&(pool->listeners_mutex));
+}
+
+void initJobContext(JobContext* job, int priority, double timeout) {
+    job->priority = priority;
+    atomic_init(&job->cancelled, false);
+    atomic_init(&job->stopped, false);
+    job->has_deadline = timeout > 0;
+    if (job->has_deadline) {
+        clock_gettime(CLOCK_MONOTONIC, &job->deadline);
+        time_t seconds = (time_t)timeout;
+        long nanoseconds = job->deadline.tv_nsec + (long)((timeout - (double)seconds) * 1e9);
+        job->deadline.tv_sec += seconds + nanoseconds / 1000000000L;
+        job->deadline.tv_nsec = nanoseconds % 1000000000L;
+    }
+}
+
+void cancelJob(JobContext* job) {
+    if (job != NULL) {
+        atomic_store(&job->cancelled, true);
+    }
+}
+
+// Whether the job was cancelled or its deadline has passed. It only reads the job
+bool isJobCancelled(JobContext* job) {
+    if (job == NULL) {
+        return false;
+    }
+    if (atomic_load_explicit(&job->cancelled, memory_order_relaxed)) {
+        return true;
+    }
+    if (!job->has_deadline) {
+        return false;
+    }
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec > job->deadline.tv_sec || (now.tv_sec == job->deadline.tv_sec && now.tv_nsec >= job->deadline.tv_nsec);
+}
+
+// The check made by the job's own tasks before they skip work. A positive answer is recorded, so isJobStopped reports it
+bool checkJobCancelled(JobContext* job) {
+    if (!isJobCancelled(job)) {
+        return false;
+    }
+    atomic_store_explicit(&job->stopped, true, memory_order_relaxed);
+    return true;
+}
+
+/*
+ * Whether checkJobCancelled found the job cancelled, so that some of its work was skipped.
+ * Unlike isJobCancelled, a job that completed before its deadline or before
+ * cancelJob keeps reporting false afterwards. Read it once the job's tasks are done.
+ */
+bool isJobStopped(JobContext* job) {
+    return job != NULL && atomic_load(&job->stopped);
+}
+
+int jobPriority(const JobContext* job) {
+    return job != NULL ? job->priority : 0;
+}
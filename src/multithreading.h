@@ -12,8 +12,28 @@
 #include <stdio.h>
 #include <unistd.h>
 #include <stdlib.h>
+#include <stdatomic.h>
+#include <time.h>
 
+#define NO_PRIORITIES 4 // Task priorities range from 0 (highest) to NO_PRIORITIES - 1 (lowest), they only decide admission
+#define POOL_RESERVED_TASKS 1 // Task slots only priority 0 may take, so that a latency critical task is not turned away by batch work
+
+/*
+ * State shared by all the tasks of one top-level job. Tasks check it before
+ * they start and long running tasks poll it, so a cancelled or expired job
+ * stops using the pool's threads.
+ */
 typedef struct {
+    int priority; // Priority given to every task of the job
+    atomic_bool cancelled;
+    atomic_bool stopped; // Set by checkJobCancelled, so only when a task of the job skipped work
+    bool has_deadline;
+    struct timespec deadline; // CLOCK_MONOTONIC time after which the job counts as cancelled
+} JobContext;
+
+typedef struct Task Task;
+
+struct Task {
     void* (*function)(void*);
     void* args;
     bool is_done;
@@ -21,32 +41,92 @@ typedef struct {
     int priority; // The priority of the task. The lower the number, the higher the priority
     pthread_mutex_t mutex; // Mutex to protect the task
     pthread_cond_t cond; // Condition variable to signal the completion of the task
-} Task;
+    JobContext* job; // The job the task belongs to, or NULL
+    void (*on_done)(Task* task); // Called by the worker once it no longer touches the task, so the hook may free it. NULL for none
+};
 
+/*
+ * Tasks waiting for a worker. Every admitted task has a worker of its own, so
+ * tasks never wait behind each other and the queue needs no priority order.
+ */
 typedef struct {
     Task** tasks;
-    int max_tasks;
     int front;
     int rear;
+    int max_tasks;
+    int size; // Number of slots in the ring
+    int no_queued_tasks;
     int no_active_tasks;
     pthread_mutex_t mutex; // Mutex to protect the queue
     pthread_cond_t cond; // Condition variable to signal the availability of tasks
 } TaskQueue;
 
+#define POOL_IDLE_TIMEOUT_MS 200 // An idle worker above min_threads retires after waiting this long for a task
+#define POOL_MIN_EFFICIENCY 0.5 // Below this share of CPU time over task run time, the pool stops growing and sheds idle workers
+#define POOL_EFFICIENCY_WINDOW_MS 50 // Task run time over which the efficiency is measured
+#define POOL_EFFICIENCY_TTL_MS 1000 // An efficiency measured longer ago than this no longer holds the pool back
+
+typedef enum {
+    SLOT_FREE, // No thread, or its thread has been joined
+    SLOT_RUNNING,
+    SLOT_EXITED // The thread retired and still has to be joined
+} WorkerState;
+
+typedef struct ThreadPool ThreadPool;
+
+/*
+ * Callback run by a worker each time a task finishes and frees a slot of the
+ * pool, for code that waits to submit once addTaskFront accepts again. It runs
+ * without any pool lock held. The node is owned by whoever registers it.
+ */
+typedef struct PoolListener {
+    void (*function)(void* arg);
+    void* arg;
+    struct PoolListener* next;
+} PoolListener;
+
 typedef struct {
-    pthread_t* threads;
+    pthread_t thread;
+    WorkerState state;
+    ThreadPool* pool;
+} WorkerSlot;
+
+struct ThreadPool {
+    WorkerSlot* workers; // max_threads slots
     int max_threads;
+    int min_threads;
+    int no_threads; // Number of live workers
+    int idle_timeout_ms;
+    double min_efficiency;
+    long window_cpu_ns; // CPU time spent by the tasks of the current measurement window
+    long window_wall_ns; // Run time of the tasks of the current measurement window
+    double efficiency; // CPU time over run time of the tasks of the last complete window
+    struct timespec efficiency_time; // CLOCK_MONOTONIC time the last window completed
     TaskQueue queue;
     bool terminated;
-} ThreadPool;
+    PoolListener* listeners;
+    atomic_int no_listeners; // Lets workers skip the listeners mutex while nobody listens
+    pthread_mutex_t listeners_mutex;
+};
 
 bool isTaskInQueue(TaskQueue* queue, Task* task);
 
 void* worker(void* args);
 ThreadPool* createThreadPool(int max_threads, int max_tasks);
+ThreadPool* createElasticThreadPool(int min_threads, int max_threads, int max_tasks);
 void destroyThreadPool(ThreadPool* pool);
 int addTaskFront(ThreadPool* pool, Task* task);
 void waitForTask(ThreadPool* pool, Task* task);
+void runTasks(ThreadPool* pool, Task* tasks, int no_tasks);
+void addPoolListener(ThreadPool* pool, PoolListener* listener);
+void removePoolListener(ThreadPool* pool, PoolListener* listener);
+
+void initJobContext(JobContext* job, int priority, double timeout);
+void cancelJob(JobContext* job);
+bool isJobCancelled(JobContext* job);
+bool checkJobCancelled(JobContext* job); // For the tasks of the job only, see isJobStopped
+bool isJobStopped(JobContext* job);
+int jobPriority(const JobContext* job);
 
 
 #endif //MULTITHREADING_H
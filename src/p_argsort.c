@@ -0,0 +1,214 @@
+/*
+ * Created by Nikos Ntokos on 24/4/24.
+ * Copyright (c) 2024, Nikos Ntokos
+ * All rights reserved.
+ */
+
+#include "p_argsort.h"
+#include "p_merge_sort.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "verbosity.h"
+
+#define ARGSORT_MIN_CHUNK 16384 // Minimum number of rows handled by one task of the linear passes
+
+static bool key_index_less(KeyIndex a, KeyIndex b) {
+    return a.key < b.key || (a.key == b.key && a.index < b.index);
+}
+
+static int key_index_search(const void* x, const void* arr, int p, int r) {
+    KeyIndex key = *(const KeyIndex*)x;
+    const KeyIndex* pairs = (const KeyIndex*)arr;
+    // low is the starting index p, and high is the max of p and r+1
+    int low = p;
+    int high = (p > r + 1) ? p : r + 1;
+    while (low < high) {
+        int mid = (low + high) / 2;
+        if (!key_index_less(pairs[mid], key))
+            high = mid;
+        else
+            low = mid + 1;
+    }
+    return high;
+}
+
+static void key_index_merge(const void* T, int p1, int r1, int p2, int r2, void* A, int p3) {
+    const KeyIndex* in = (const KeyIndex*)T;
+    KeyIndex* out = (KeyIndex*)A;
+    while (p1 <= r1 && p2 <= r2) {
+        out[p3++] = key_index_less(in[p2], in[p1]) ? in[p2++] : in[p1++];
+    }
+    while (p1 <= r1) {
+        out[p3++] = in[p1++];
+    }
+    while (p2 <= r2) {
+        out[p3++] = in[p2++];
+    }
+}
+
+const SortKind key_index_sort_kind = {sizeof(KeyIndex), key_index_search, key_index_merge, NULL};
+
+// Number of chunks a pass over n rows is split into
+static int no_chunks(ThreadPool* pool, int n) {
+    if (pool == NULL) {
+        return 1;
+    }
+    int chunks = pool->max_threads + 1; // The calling thread takes the chunks the queue rejects
+    int max_chunks = n / ARGSORT_MIN_CHUNK;
+    if (chunks > max_chunks) {
+        chunks = max_chunks;
+    }
+    return chunks < 1 ? 1 : chunks;
+}
+
+static void* column_range(void* args) {
+    ColumnRangeArgs* rangeArgs = (ColumnRangeArgs*) args;
+    const int* column = rangeArgs->column;
+    int min = column[rangeArgs->p];
+    int max = column[rangeArgs->p];
+    for (int i = rangeArgs->p + 1; i <= rangeArgs->r; i++) {
+        if (column[i] < min) min = column[i];
+        if (column[i] > max) max = column[i];
+    }
+    rangeArgs->min = min;
+    rangeArgs->max = max;
+    return NULL;
+}
+
+static void* pack_keys(void* args) {
+    PackArgs* packArgs = (PackArgs*) args;
+    for (int i = packArgs->p; i <= packArgs->r; i++) {
+        int row = packArgs->perm[i];
+        uint64_t key = 0;
+        for (int c = packArgs->first; c <= packArgs->last; c++) {
+            key = (key << packArgs->bits[c])
+                  | (uint64_t)((int64_t)packArgs->columns[c][row] - (int64_t)packArgs->ranges[c].min);
+        }
+        KeyIndex pair = {key, i};
+        packArgs->pairs[i] = pair;
+    }
+    return NULL;
+}
+
+static void* permute_rows(void* args) {
+    PermuteArgs* permuteArgs = (PermuteArgs*) args;
+    for (int i = permuteArgs->p; i <= permuteArgs->r; i++) {
+        permuteArgs->perm[i] = permuteArgs->previous[permuteArgs->sorted[i].index];
+    }
+    return NULL;
+}
+
+// Number of bits needed to store value - min for every value of the column
+static int column_bits(const ColumnRangeArgs* range) {
+    uint64_t span = (uint64_t)((int64_t)range->max - (int64_t)range->min);
+    int bits = 0;
+    while (span > 0) {
+        bits++;
+        span >>= 1;
+    }
+    return bits;
+}
+
+int p_argsort(ThreadPool* pool, const int* keys, int n, int* perm) {
+    const int* columns[1] = {keys};
+    return p_argsort_columns(pool, columns, 1, n, perm);
+}
+
+int p_argsort_columns(ThreadPool* pool, const int* const* columns, int no_columns, int n, int* perm) {
+    if (columns == NULL || perm == NULL || no_columns <= 0 || n < 0) {
+        return -1;
+    }
+    for (int c = 0; c < no_columns; c++) {
+        if (columns[c] == NULL) {
+            return -1;
+        }
+    }
+    for (int i = 0; i < n; i++) {
+        perm[i] = i;
+    }
+    if (n <= 1) {
+        return 0;
+    }
+
+    int chunks = no_chunks(pool, n);
+    int no_tasks = no_columns * chunks; // One range scan per chunk of every column, the later passes use the first chunks
+    ColumnRangeArgs* ranges = (ColumnRangeArgs*)malloc(no_tasks * sizeof(ColumnRangeArgs));
+    PackArgs* packs = (PackArgs*)malloc(chunks * sizeof(PackArgs));
+    PermuteArgs* permutes = (PermuteArgs*)malloc(chunks * sizeof(PermuteArgs));
+    Task* tasks = (Task*)calloc(no_tasks, sizeof(Task));
+    int* bits = (int*)malloc(no_columns * sizeof(int));
+    KeyIndex* pairs = (KeyIndex*)malloc(n * sizeof(KeyIndex));
+    KeyIndex* sorted = (KeyIndex*)malloc(n * sizeof(KeyIndex));
+    KeyIndex* scratch = (KeyIndex*)malloc(2 * (size_t)n * sizeof(KeyIndex)); // Reused by the sort of every group
+    int* previous = (int*)malloc(n * sizeof(int));
+    if (!ranges || !packs || !permutes || !tasks || !bits || !pairs || !sorted || !scratch || !previous) {
+        fprintf(stderr, "Failed to allocate memory\n");
+        exit(EXIT_FAILURE);
+    }
+
+    // The value range of every column decides how many bits it takes in a packed key. Every chunk of
+    // every column is scanned by its own task, then the ranges of a column are folded into its first chunk
+    for (int c = 0; c < no_columns; c++) {
+        for (int k = 0; k < chunks; k++) {
+            int t = c * chunks + k;
+            ColumnRangeArgs range_args = {columns[c], (int)((long)n * k / chunks), (int)((long)n * (k + 1) / chunks) - 1, 0, 0};
+            ranges[t] = range_args;
+            tasks[t] = (Task){.function = column_range, .args = &ranges[t]};
+        }
+    }
+    runTasks(pool, tasks, no_tasks);
+    for (int c = 0; c < no_columns; c++) {
+        ColumnRangeArgs* range = &ranges[c * chunks];
+        for (int k = 1; k < chunks; k++) {
+            if (range[k].min < range->min) range->min = range[k].min;
+            if (range[k].max > range->max) range->max = range[k].max;
+        }
+        ranges[c] = *range;
+        bits[c] = column_bits(&ranges[c]);
+    }
+
+    // Columns [first, last] form the least significant group not sorted yet, groups are sorted from the last one backwards
+    int last = no_columns - 1;
+    while (last >= 0) {
+        int first = last;
+        int group_bits = bits[last];
+        while (first > 0 && group_bits + bits[first - 1] <= 64) {
+            first--;
+            group_bits += bits[first];
+        }
+        print_verbosity(DEBUG, "{p_argsort_columns}: Sorting columns %d..%d packed in %d bits", first, last, group_bits);
+
+        if (group_bits > 0) { // A group of constant columns does not change the order
+            for (int k = 0; k < chunks; k++) {
+                int p = (int)((long)n * k / chunks);
+                int r = (int)((long)n * (k + 1) / chunks) - 1;
+                packs[k] = (PackArgs){columns, ranges, bits, first, last, perm, pairs, p, r};
+                tasks[k] = (Task){.function = pack_keys, .args = &packs[k]};
+            }
+            runTasks(pool, tasks, chunks);
+
+            KindSortArgs args = {&key_index_sort_kind, pairs, 0, n - 1, sorted, 0, pool, 0, NULL, scratch, scratch + n};
+            p_merge_sort_kind(&args);
+
+            memcpy(previous, perm, n * sizeof(int));
+            for (int k = 0; k < chunks; k++) {
+                permutes[k] = (PermuteArgs){previous, sorted, perm, packs[k].p, packs[k].r};
+                tasks[k] = (Task){.function = permute_rows, .args = &permutes[k]};
+            }
+            runTasks(pool, tasks, chunks);
+        }
+        last = first - 1;
+    }
+
+    free(previous);
+    free(scratch);
+    free(sorted);
+    free(pairs);
+    free(bits);
+    free(tasks);
+    free(permutes);
+    free(packs);
+    free(ranges);
+    return 0;
+}
@@ -0,0 +1,74 @@
+/*
+ * Created by Nikos Ntokos on 24/4/24.
+ * Copyright (c) 2024, Nikos Ntokos
+ * All rights reserved.
+ */
+
+#ifndef P_ARGSORT_H
+#define P_ARGSORT_H
+
+#include <stdint.h>
+#include "multithreading.h"
+#include "p_merge_sort.h"
+
+typedef struct {
+    uint64_t key; // Packed, order-preserving key
+    int index; // Position of the row in the order being refined, breaks ties so that the sort is stable
+} KeyIndex;
+
+typedef struct {
+    const int* column;
+    int p;
+    int r;
+    int min;
+    int max;
+} ColumnRangeArgs;
+
+typedef struct {
+    const int* const* columns;
+    const ColumnRangeArgs* ranges; // Value range of every column
+    const int* bits; // Bits every column takes in the packed key
+    int first; // Group of columns packed into the keys, the most significant first
+    int last;
+    const int* perm; // Current order of the rows
+    KeyIndex* pairs;
+    int p;
+    int r;
+} PackArgs;
+
+typedef struct {
+    const int* previous; // Order of the rows before the pass
+    const KeyIndex* sorted;
+    int* perm;
+    int p;
+    int r;
+} PermuteArgs;
+
+extern const SortKind key_index_sort_kind; // Sorts KeyIndex pairs with p_merge_sort_kind
+
+/**
+ * Compute the stable sorting permutation of a key column
+ * @param pool The thread pool to use, or NULL to run on the calling thread
+ * @param keys The key column
+ * @param n The number of rows
+ * @param perm The output permutation, perm[i] is the row of rank i
+ * @return 0 on success, -1 on invalid arguments
+ */
+int p_argsort(ThreadPool* pool, const int* keys, int n, int* perm);
+
+/**
+ * Compute the stable sorting permutation of rows ordered lexicographically by
+ * several key columns, columns[0] being the most significant. Neighbouring
+ * columns are packed into one 64-bit key while their value ranges fit, so
+ * narrow columns are sorted in a single pass; the remaining groups are sorted
+ * least significant first, each pass keeping the order of the previous one
+ * @param pool The thread pool to use, or NULL to run on the calling thread
+ * @param columns The key columns
+ * @param no_columns The number of key columns
+ * @param n The number of rows
+ * @param perm The output permutation, perm[i] is the row of rank i
+ * @return 0 on success, -1 on invalid arguments
+ */
+int p_argsort_columns(ThreadPool* pool, const int* const* columns, int no_columns, int n, int* perm);
+
+#endif //P_ARGSORT_H
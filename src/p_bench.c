@@ -0,0 +1,364 @@
+/*
+ * Created by Nikos Ntokos on 24/4/24.
+ * Copyright (c) 2024, Nikos Ntokos
+ * All rights reserved.
+ */
+
+/*
+ * Microbenchmarks for the ThreadPool primitives and the merge kernels.
+ * Every benchmark is run a few times to warm up, then repeatedly; the report
+ * gives the mean cost per operation with its 95% confidence interval.
+ * With --baseline FILE the means are compared against FILE (which is written
+ * when it does not exist yet) and the exit code is 1 on a regression.
+ */
+
+#include "p_merge_sort.h"
+#include "p_argsort.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include "verbosity.h"
+
+#define BENCH_THREADS 3
+#define BENCH_TASKS_IN_QUEUE 3
+
+#define DEFAULT_WARMUP 3
+#define DEFAULT_REPETITIONS 15
+#define QUICK_REPETITIONS 7
+#define DEFAULT_TOLERANCE 0.5 // Relative slowdown over the baseline reported as a regression
+
+#define MAX_BENCHMARKS 32
+#define MAX_NAME_LENGTH 64
+
+typedef struct {
+    const char* name;
+    long (*run)(void* context); // Runs one sample and returns the number of operations it did
+    void* context;
+} Benchmark;
+
+typedef struct {
+    double mean; // Nanoseconds per operation
+    double stddev;
+    double ci; // Half-width of the 95% confidence interval of the mean
+    double median;
+} BenchStats;
+
+typedef struct {
+    ThreadPool* pool;
+    int iterations;
+    int producers;
+} PoolContext;
+
+typedef struct {
+    const int* arr;
+    const int* targets;
+    int n;
+    int iterations;
+} SearchContext;
+
+typedef struct {
+    void* T; // Two sorted halves
+    void* A; // Output
+    int n;
+    ThreadPool* pool;
+} MergeContext;
+
+// Two-sided 95% quantiles of Student's t distribution, indexed by degrees of freedom - 1
+static const double t_table[30] = {
+    12.706, 4.303, 3.182, 2.776, 2.571, 2.447, 2.365, 2.306, 2.262, 2.228,
+    2.201, 2.179, 2.160, 2.145, 2.131, 2.120, 2.110, 2.101, 2.093, 2.086,
+    2.080, 2.074, 2.069, 2.064, 2.060, 2.056, 2.052, 2.048, 2.045, 2.042
+};
+
+static double now_ns() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec * 1e9 + (double)ts.tv_nsec;
+}
+
+static int compare_doubles(const void* a, const void* b) {
+    double x = *(const double*)a;
+    double y = *(const double*)b;
+    return (x > y) - (x < y);
+}
+
+static void* empty_task(void* args) {
+    return args;
+}
+
+static long bench_create_destroy(void* context) {
+    PoolContext* ctx = (PoolContext*) context;
+    for (int i = 0; i < ctx->iterations; i++) {
+        ThreadPool* pool = createThreadPool(BENCH_THREADS, BENCH_TASKS_IN_QUEUE);
+        destroyThreadPool(pool);
+    }
+    return ctx->iterations;
+}
+
+static long bench_empty_roundtrip(void* context) {
+    PoolContext* ctx = (PoolContext*) context;
+    for (int i = 0; i < ctx->iterations; i++) {
+        Task task = {empty_task, NULL};
+        if (addTaskFront(ctx->pool, &task) == 0) {
+            waitForTask(ctx->pool, &task);
+        }
+    }
+    return ctx->iterations;
+}
+
+static void* producer(void* args) {
+    PoolContext* ctx = (PoolContext*) args;
+    int per_producer = ctx->iterations / ctx->producers;
+    for (int i = 0; i < per_producer; i++) {
+        Task task = {empty_task, NULL};
+        if (addTaskFront(ctx->pool, &task) == 0) {
+            waitForTask(ctx->pool, &task);
+        } else {
+            empty_task(NULL); // Rejected by a full queue, the producer runs it itself like p_merge_sort does
+        }
+    }
+    return NULL;
+}
+
+static long bench_queue_producers(void* context) {
+    PoolContext* ctx = (PoolContext*) context;
+    pthread_t threads[16];
+    for (int i = 0; i < ctx->producers; i++) {
+        pthread_create(&threads[i], NULL, producer, ctx);
+    }
+    for (int i = 0; i < ctx->producers; i++) {
+        pthread_join(threads[i], NULL);
+    }
+    return (long)(ctx->iterations / ctx->producers) * ctx->producers;
+}
+
+static long bench_binary_search(void* context) {
+    SearchContext* ctx = (SearchContext*) context;
+    volatile int sink = 0;
+    for (int i = 0; i < ctx->iterations; i++) {
+        sink += binary_search(ctx->targets[i], ctx->arr, 0, ctx->n - 1);
+    }
+    (void)sink;
+    return ctx->iterations;
+}
+
+static long bench_p_merge(void* context) {
+    MergeContext* ctx = (MergeContext*) context;
+    int half = ctx->n / 2;
+    MergeArgs args = {(int*)ctx->T, 0, half - 1, half, ctx->n - 1, (int*)ctx->A, 0, ctx->pool, 0};
+    p_merge(&args);
+    return ctx->n;
+}
+
+static long bench_p_merge_key_index(void* context) {
+    MergeContext* ctx = (MergeContext*) context;
+    int half = ctx->n / 2;
+    KindMergeArgs args = {&key_index_sort_kind, ctx->T, 0, half - 1, half, ctx->n - 1, ctx->A, 0, ctx->pool, 0, NULL};
+    p_merge_kind(&args);
+    return ctx->n;
+}
+
+static BenchStats run_benchmark(const Benchmark* bench, int warmup, int repetitions) {
+    double* samples = (double*)malloc(repetitions * sizeof(double));
+    if (!samples) {
+        fprintf(stderr, "Failed to allocate memory\n");
+        exit(EXIT_FAILURE);
+    }
+    for (int i = 0; i < warmup; i++) {
+        bench->run(bench->context);
+    }
+    for (int i = 0; i < repetitions; i++) {
+        double start = now_ns();
+        long ops = bench->run(bench->context);
+        samples[i] = (now_ns() - start) / (double)ops;
+    }
+
+    BenchStats stats = {0, 0, 0, 0};
+    for (int i = 0; i < repetitions; i++) {
+        stats.mean += samples[i];
+    }
+    stats.mean /= repetitions;
+    if (repetitions > 1) {
+        double sum_sq = 0;
+        for (int i = 0; i < repetitions; i++) {
+            sum_sq += (samples[i] - stats.mean) * (samples[i] - stats.mean);
+        }
+        stats.stddev = sqrt(sum_sq / (repetitions - 1));
+        double t = (repetitions - 1 <= 30) ? t_table[repetitions - 2] : 1.96;
+        stats.ci = t * stats.stddev / sqrt(repetitions);
+    }
+    qsort(samples, repetitions, sizeof(double), compare_doubles);
+    stats.median = (repetitions % 2) ? samples[repetitions / 2]
+                                     : (samples[repetitions / 2 - 1] + samples[repetitions / 2]) / 2;
+    free(samples);
+    return stats;
+}
+
+// Read "name mean" lines from a baseline file, returns the number of entries or -1 if the file does not exist
+static int read_baseline(const char* path, char names[][MAX_NAME_LENGTH], double* means, int max_entries) {
+    FILE* file = fopen(path, "r");
+    if (file == NULL) {
+        return -1;
+    }
+    int count = 0;
+    while (count < max_entries && fscanf(file, "%63s %lf", names[count], &means[count]) == 2) {
+        count++;
+    }
+    fclose(file);
+    return count;
+}
+
+static int write_baseline(const char* path, const Benchmark* benchmarks, const BenchStats* stats, int count) {
+    FILE* file = fopen(path, "w");
+    if (file == NULL) {
+        fprintf(stderr, "{p_bench}: Cannot write baseline %s\n", path);
+        return -1;
+    }
+    for (int i = 0; i < count; i++) {
+        fprintf(file, "%s %f\n", benchmarks[i].name, stats[i].mean);
+    }
+    fclose(file);
+    return 0;
+}
+
+static void usage(const char* program) {
+    fprintf(stderr, "Usage: %s [--quick] [--repetitions N] [--baseline FILE] [--update-baseline] [--tolerance T]\n", program);
+}
+
+int main(int argc, char* argv[]) {
+    set_verbosity(SILENT);
+    int warmup = DEFAULT_WARMUP;
+    int repetitions = DEFAULT_REPETITIONS;
+    double tolerance = DEFAULT_TOLERANCE;
+    const char* baseline = NULL;
+    bool update_baseline = false;
+    int scale = 1; // Divides the amount of work per sample in quick mode
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--quick") == 0) {
+            repetitions = QUICK_REPETITIONS;
+            warmup = 1;
+            scale = 4;
+        } else if (strcmp(argv[i], "--repetitions") == 0 && i + 1 < argc) {
+            repetitions = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--baseline") == 0 && i + 1 < argc) {
+            baseline = argv[++i];
+        } else if (strcmp(argv[i], "--update-baseline") == 0) {
+            update_baseline = true;
+        } else if (strcmp(argv[i], "--tolerance") == 0 && i + 1 < argc) {
+            tolerance = atof(argv[++i]);
+        } else {
+            usage(argv[0]);
+            return EXIT_FAILURE;
+        }
+    }
+    if (repetitions < 2 || tolerance < 0) {
+        usage(argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    ThreadPool* pool = createThreadPool(BENCH_THREADS, BENCH_TASKS_IN_QUEUE);
+
+    // Inputs
+    int search_n = 1 << 20;
+    int search_iterations = 1000000 / scale;
+    int* sorted = (int*)malloc(search_n * sizeof(int));
+    int* targets = (int*)malloc(search_iterations * sizeof(int));
+    int merge_n = (1 << 20) / scale;
+    int* merge_T = (int*)malloc(merge_n * sizeof(int));
+    int* merge_A = (int*)malloc(merge_n * sizeof(int));
+    KeyIndex* pairs_T = (KeyIndex*)malloc(merge_n * sizeof(KeyIndex));
+    KeyIndex* pairs_A = (KeyIndex*)malloc(merge_n * sizeof(KeyIndex));
+    if (!sorted || !targets || !merge_T || !merge_A || !pairs_T || !pairs_A) {
+        fprintf(stderr, "Failed to allocate memory\n");
+        exit(EXIT_FAILURE);
+    }
+    srand(5311);
+    for (int i = 0; i < search_n; i++) {
+        sorted[i] = 2 * i;
+    }
+    for (int i = 0; i < search_iterations; i++) {
+        targets[i] = rand() % (2 * search_n);
+    }
+    // Interleaved halves (evens, then odds) so that every level of the merge does real work
+    int half = merge_n / 2;
+    for (int i = 0; i < merge_n; i++) {
+        int value = (i < half) ? 2 * i : 2 * (i - half) + 1;
+        merge_T[i] = value;
+        KeyIndex pair = {(uint64_t)value, i};
+        pairs_T[i] = pair;
+    }
+
+    PoolContext create_ctx = {NULL, 20 / scale, 0};
+    PoolContext roundtrip_ctx = {pool, 20000 / scale, 1};
+    PoolContext producers_ctx[3] = {{pool, 20000 / scale, 1}, {pool, 20000 / scale, 2}, {pool, 20000 / scale, 4}};
+    SearchContext search_ctx = {sorted, targets, search_n, search_iterations};
+    MergeContext merge_seq_ctx = {merge_T, merge_A, merge_n, NULL};
+    MergeContext merge_pool_ctx = {merge_T, merge_A, merge_n, pool};
+    MergeContext pairs_seq_ctx = {pairs_T, pairs_A, merge_n, NULL};
+    MergeContext pairs_pool_ctx = {pairs_T, pairs_A, merge_n, pool};
+
+    Benchmark benchmarks[] = {
+        {"pool_create_destroy", bench_create_destroy, &create_ctx},
+        {"empty_task_roundtrip", bench_empty_roundtrip, &roundtrip_ctx},
+        {"queue_1_producer", bench_queue_producers, &producers_ctx[0]},
+        {"queue_2_producers", bench_queue_producers, &producers_ctx[1]},
+        {"queue_4_producers", bench_queue_producers, &producers_ctx[2]},
+        {"binary_search_1M", bench_binary_search, &search_ctx},
+        {"p_merge_int4_seq", bench_p_merge, &merge_seq_ctx},
+        {"p_merge_int4_pool", bench_p_merge, &merge_pool_ctx},
+        {"p_merge_key_index16_seq", bench_p_merge_key_index, &pairs_seq_ctx},
+        {"p_merge_key_index16_pool", bench_p_merge_key_index, &pairs_pool_ctx},
+    };
+    int no_benchmarks = sizeof(benchmarks) / sizeof(benchmarks[0]);
+    BenchStats stats[MAX_BENCHMARKS];
+
+    char baseline_names[MAX_BENCHMARKS][MAX_NAME_LENGTH];
+    double baseline_means[MAX_BENCHMARKS];
+    int no_baseline = -1;
+    if (baseline != NULL && !update_baseline) {
+        no_baseline = read_baseline(baseline, baseline_names, baseline_means, MAX_BENCHMARKS);
+    }
+
+    printf("%-26s %12s %12s %12s %12s %10s\n", "benchmark", "mean ns/op", "+-95% CI", "median", "stddev", "baseline");
+    int regressions = 0;
+    for (int i = 0; i < no_benchmarks; i++) {
+        stats[i] = run_benchmark(&benchmarks[i], warmup, repetitions);
+        printf("%-26s %12.2f %12.2f %12.2f %12.2f", benchmarks[i].name, stats[i].mean, stats[i].ci, stats[i].median, stats[i].stddev);
+
+        for (int j = 0; j < no_baseline; j++) {
+            if (strcmp(baseline_names[j], benchmarks[i].name) == 0) {
+                // Only a slowdown that the confidence interval cannot explain counts as a regression
+                bool regressed = stats[i].mean - stats[i].ci > baseline_means[j] * (1 + tolerance);
+                printf(" %+9.1f%%%s", 100 * (stats[i].mean / baseline_means[j] - 1), regressed ? " REGRESSION" : "");
+                regressions += regressed;
+                break;
+            }
+        }
+        printf("\n");
+    }
+
+    int status = EXIT_SUCCESS;
+    if (baseline != NULL && no_baseline < 0) {
+        if (write_baseline(baseline, benchmarks, stats, no_benchmarks) == 0) {
+            printf("Baseline written to %s\n", baseline);
+        } else {
+            status = EXIT_FAILURE;
+        }
+    }
+    if (regressions > 0) {
+        printf("%d benchmark(s) regressed by more than %.0f%% over %s\n", regressions, 100 * tolerance, baseline);
+        status = EXIT_FAILURE;
+    }
+
+    destroyThreadPool(pool);
+    free(pairs_A);
+    free(pairs_T);
+    free(merge_A);
+    free(merge_T);
+    free(targets);
+    free(sorted);
+    return status;
+}
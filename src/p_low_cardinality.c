@@ -0,0 +1,301 @@
+/*
+ * Created by Nikos Ntokos on 24/4/24.
+ * Copyright (c) 2024, Nikos Ntokos
+ * All rights reserved.
+ */
+
+#include "p_low_cardinality.h"
+#include "p_merge_sort.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "verbosity.h"
+
+#define LOW_CARDINALITY_MIN_CHUNK 16384 // Minimum number of elements handled by one task
+#define LOW_CARDINALITY_MAX_COUNTERS (1 << 22) // Histogram counters allowed over all the chunks of the dense path
+#define LOW_CARDINALITY_TABLE_BITS 13
+#define LOW_CARDINALITY_TABLE_SIZE (1 << LOW_CARDINALITY_TABLE_BITS)
+#define LOW_CARDINALITY_MAX_KEYS (LOW_CARDINALITY_TABLE_SIZE / 2) // Keeps the hash tables at most half full
+#define LOW_CARDINALITY_SAMPLE_SIZE 1024
+
+static void* check_alloc(void* ptr) {
+    if (!ptr) {
+        fprintf(stderr, "Failed to allocate memory\n");
+        exit(EXIT_FAILURE);
+    }
+    return ptr;
+}
+
+static int compare_ints(const void* a, const void* b) {
+    int x = *(const int*)a;
+    int y = *(const int*)b;
+    return (x > y) - (x < y);
+}
+
+static int no_chunks(ThreadPool* pool, int n) {
+    if (pool == NULL) {
+        return 1;
+    }
+    int chunks = pool->max_threads + 1; // The calling thread takes the chunks the queue rejects
+    int max_chunks = n / LOW_CARDINALITY_MIN_CHUNK;
+    if (chunks > max_chunks) {
+        chunks = max_chunks;
+    }
+    return chunks < 1 ? 1 : chunks;
+}
+
+static unsigned hash_key(int key) {
+    return ((unsigned)key * 2654435761u) >> (32 - LOW_CARDINALITY_TABLE_BITS);
+}
+
+static void* range_chunk(void* args) {
+    RangeArgs* rangeArgs = (RangeArgs*) args;
+    const int* A = rangeArgs->A;
+    int min = A[rangeArgs->p];
+    int max = A[rangeArgs->p];
+    for (int i = rangeArgs->p + 1; i <= rangeArgs->r; i++) {
+        if (A[i] < min) min = A[i];
+        if (A[i] > max) max = A[i];
+    }
+    rangeArgs->min = min;
+    rangeArgs->max = max;
+    return NULL;
+}
+
+static void* histogram_chunk(void* args) {
+    HistogramArgs* histogramArgs = (HistogramArgs*) args;
+    const int* A = histogramArgs->A;
+    int* counts = histogramArgs->counts;
+    int min = histogramArgs->min;
+    for (int i = histogramArgs->p; i <= histogramArgs->r; i++) {
+        counts[A[i] - min]++;
+    }
+    return NULL;
+}
+
+static void* hash_count_chunk(void* args) {
+    HashCountArgs* hashArgs = (HashCountArgs*) args;
+    const int* A = hashArgs->A;
+    int* keys = hashArgs->keys;
+    int* counts = hashArgs->counts;
+    int no_keys = 0;
+
+    for (int i = hashArgs->p; i <= hashArgs->r; i++) {
+        int x = A[i];
+        unsigned h = hash_key(x);
+        while (counts[h] != 0 && keys[h] != x) {
+            h = (h + 1) & (LOW_CARDINALITY_TABLE_SIZE - 1);
+        }
+        if (counts[h] == 0) {
+            if (no_keys == LOW_CARDINALITY_MAX_KEYS) {
+                hashArgs->overflow = true;
+                break;
+            }
+            keys[h] = x;
+            no_keys++;
+        }
+        counts[h]++;
+    }
+    hashArgs->no_keys = no_keys;
+    return NULL;
+}
+
+static void* fill_chunk(void* args) {
+    FillArgs* fillArgs = (FillArgs*) args;
+    int* out = fillArgs->B + fillArgs->offset;
+    for (int k = fillArgs->first; k <= fillArgs->last; k++) {
+        int key = fillArgs->keys ? fillArgs->keys[k] : fillArgs->min + k;
+        int count = fillArgs->counts[k];
+        // The whole block of equal keys is written at once
+        for (int j = 0; j < count; j++) {
+            out[j] = key;
+        }
+        out += count;
+    }
+    return NULL;
+}
+
+// Run function on every element of args, an array of chunks argument structs of args_size bytes each
+static void run_chunks(ThreadPool* pool, void* (*function)(void*), void* args, size_t args_size, int chunks) {
+    Task* tasks = check_alloc(calloc(chunks, sizeof(Task)));
+    for (int c = 0; c < chunks; c++) {
+        tasks[c].function = function;
+        tasks[c].args = (char*)args + c * args_size;
+    }
+    runTasks(pool, tasks, chunks);
+    free(tasks);
+}
+
+// Write counts[k] copies of every key k to B, the key ranges are split so that every task writes about n / chunks elements
+static void fill_blocks(ThreadPool* pool, int* B, int n, const int* keys, int min, const int* counts, int no_keys, int chunks) {
+    FillArgs* fills = check_alloc(malloc(chunks * sizeof(FillArgs)));
+    int no_fills = 0;
+    int offset = 0;
+    int first = 0;
+    int written = 0;
+    for (int k = 0; k < no_keys; k++) {
+        written += counts[k];
+        bool last_key = k == no_keys - 1;
+        if (last_key || (no_fills < chunks - 1 && written >= (long)n * (no_fills + 1) / chunks)) {
+            FillArgs fill_args = {B, offset, keys, min, counts, first, k};
+            fills[no_fills++] = fill_args;
+            offset = written;
+            first = k + 1;
+        }
+    }
+    run_chunks(pool, fill_chunk, fills, sizeof(FillArgs), no_fills);
+    free(fills);
+}
+
+// Counting sort of keys within [min, max], with one histogram per chunk
+static void dense_counting_sort(ThreadPool* pool, const int* A, int n, int* B, int min, int range) {
+    int chunks = no_chunks(pool, n);
+    if ((long)range * chunks > LOW_CARDINALITY_MAX_COUNTERS) {
+        chunks = LOW_CARDINALITY_MAX_COUNTERS / range;
+    }
+    if (chunks < 1) {
+        chunks = 1;
+    }
+    int* counts = check_alloc(calloc((size_t)range * chunks, sizeof(int)));
+    HistogramArgs* histograms = check_alloc(malloc(chunks * sizeof(HistogramArgs)));
+    for (int c = 0; c < chunks; c++) {
+        HistogramArgs histogram_args = {A, (int)((long)n * c / chunks), (int)((long)n * (c + 1) / chunks) - 1, min, counts + (size_t)range * c};
+        histograms[c] = histogram_args;
+    }
+    run_chunks(pool, histogram_chunk, histograms, sizeof(HistogramArgs), chunks);
+
+    for (int c = 1; c < chunks; c++) {
+        const int* chunk_counts = counts + (size_t)range * c;
+        for (int k = 0; k < range; k++) {
+            counts[k] += chunk_counts[k];
+        }
+    }
+    fill_blocks(pool, B, n, NULL, min, counts, range, no_chunks(pool, n));
+
+    free(histograms);
+    free(counts);
+}
+
+// Count the distinct keys in per-chunk hash tables, returns -1 when there are too many of them
+static int hash_counting_sort(ThreadPool* pool, const int* A, int n, int* B) {
+    int chunks = no_chunks(pool, n);
+    int* tables = check_alloc(malloc((size_t)chunks * LOW_CARDINALITY_TABLE_SIZE * sizeof(int)));
+    int* table_counts = check_alloc(calloc((size_t)chunks * LOW_CARDINALITY_TABLE_SIZE, sizeof(int)));
+    HashCountArgs* hashes = check_alloc(malloc(chunks * sizeof(HashCountArgs)));
+    for (int c = 0; c < chunks; c++) {
+        HashCountArgs hash_args = {A, (int)((long)n * c / chunks), (int)((long)n * (c + 1) / chunks) - 1,
+                                   tables + (size_t)LOW_CARDINALITY_TABLE_SIZE * c,
+                                   table_counts + (size_t)LOW_CARDINALITY_TABLE_SIZE * c, 0, false};
+        hashes[c] = hash_args;
+    }
+    run_chunks(pool, hash_count_chunk, hashes, sizeof(HashCountArgs), chunks);
+
+    int status = 0;
+    int total_keys = 0;
+    for (int c = 0; c < chunks; c++) {
+        if (hashes[c].overflow) {
+            status = -1;
+        }
+        total_keys += hashes[c].no_keys;
+    }
+
+    if (status == 0) {
+        // Distinct keys of all the chunks, sorted and deduplicated
+        int* keys = check_alloc(malloc(total_keys * sizeof(int)));
+        int no_keys = 0;
+        for (size_t slot = 0; slot < (size_t)chunks * LOW_CARDINALITY_TABLE_SIZE; slot++) {
+            if (table_counts[slot] != 0) {
+                keys[no_keys++] = tables[slot];
+            }
+        }
+        qsort(keys, no_keys, sizeof(int), compare_ints);
+        int no_unique = 0;
+        for (int k = 0; k < no_keys; k++) {
+            if (no_unique == 0 || keys[no_unique - 1] != keys[k]) {
+                keys[no_unique++] = keys[k];
+            }
+        }
+
+        int* counts = check_alloc(calloc(no_unique, sizeof(int)));
+        for (size_t slot = 0; slot < (size_t)chunks * LOW_CARDINALITY_TABLE_SIZE; slot++) {
+            if (table_counts[slot] != 0) {
+                counts[binary_search(tables[slot], keys, 0, no_unique - 1)] += table_counts[slot];
+            }
+        }
+        print_verbosity(DEBUG, "{hash_counting_sort}: %d distinct keys", no_unique);
+        fill_blocks(pool, B, n, keys, 0, counts, no_unique, chunks);
+        free(counts);
+        free(keys);
+    }
+
+    free(hashes);
+    free(table_counts);
+    free(tables);
+    return status;
+}
+
+// Estimate from a sample whether the distinct keys of the input fit in the hash tables.
+// The number of keys missing from the sample is extrapolated from the keys seen once or twice (Chao1)
+static bool is_duplicate_heavy(const int* A, int n) {
+    int sample[LOW_CARDINALITY_SAMPLE_SIZE];
+    for (int i = 0; i < LOW_CARDINALITY_SAMPLE_SIZE; i++) {
+        sample[i] = A[(long)i * n / LOW_CARDINALITY_SAMPLE_SIZE];
+    }
+    qsort(sample, LOW_CARDINALITY_SAMPLE_SIZE, sizeof(int), compare_ints);
+    long distinct = 0;
+    long once = 0;
+    long twice = 0;
+    for (int i = 0; i < LOW_CARDINALITY_SAMPLE_SIZE;) {
+        int j = i + 1;
+        while (j < LOW_CARDINALITY_SAMPLE_SIZE && sample[j] == sample[i]) {
+            j++;
+        }
+        distinct++;
+        once += j - i == 1;
+        twice += j - i == 2;
+        i = j;
+    }
+    long estimate = distinct + once * (once - 1) / (2 * (twice + 1));
+    print_verbosity(DEBUG, "{is_duplicate_heavy}: %ld distinct keys in a sample of %d, about %ld in the input",
+                    distinct, LOW_CARDINALITY_SAMPLE_SIZE, estimate);
+    return estimate <= LOW_CARDINALITY_MAX_KEYS;
+}
+
+int p_sort_low_cardinality(ThreadPool* pool, const int* A, int n, int* B) {
+    if (A == NULL || B == NULL || n < 0) {
+        return -1;
+    }
+    if (n == 0) {
+        return 0;
+    }
+
+    int chunks = no_chunks(pool, n);
+    RangeArgs* ranges = check_alloc(malloc(chunks * sizeof(RangeArgs)));
+    for (int c = 0; c < chunks; c++) {
+        RangeArgs range_args = {A, (int)((long)n * c / chunks), (int)((long)n * (c + 1) / chunks) - 1, 0, 0};
+        ranges[c] = range_args;
+    }
+    run_chunks(pool, range_chunk, ranges, sizeof(RangeArgs), chunks);
+    int min = ranges[0].min;
+    int max = ranges[0].max;
+    for (int c = 1; c < chunks; c++) {
+        if (ranges[c].min < min) min = ranges[c].min;
+        if (ranges[c].max > max) max = ranges[c].max;
+    }
+    free(ranges);
+
+    long range = (long)max - (long)min + 1;
+    if (range <= n) {
+        print_verbosity(DEBUG, "{p_sort_low_cardinality}: Counting %ld keys in [%d, %d]", range, min, max);
+        dense_counting_sort(pool, A, n, B, min, (int)range);
+        return 0;
+    }
+    if (n >= LOW_CARDINALITY_SAMPLE_SIZE && is_duplicate_heavy(A, n) && hash_counting_sort(pool, A, n, B) == 0) {
+        return 0;
+    }
+
+    print_verbosity(DEBUG, "{p_sort_low_cardinality}: Falling back to p_merge_sort");
+    SortArgs args = {(int*)A, 0, n - 1, B, 0, pool, 0, NULL}; // p_merge_sort only reads A
+    p_merge_sort(&args);
+    return 0;
+}
@@ -0,0 +1,64 @@
+/*
+ * Created by Nikos Ntokos on 24/4/24.
+ * Copyright (c) 2024, Nikos Ntokos
+ * All rights reserved.
+ */
+
+#ifndef P_LOW_CARDINALITY_H
+#define P_LOW_CARDINALITY_H
+
+#include <stdbool.h>
+#include "multithreading.h"
+
+typedef struct {
+    const int* A;
+    int p;
+    int r;
+    int min;
+    int max;
+} RangeArgs;
+
+typedef struct {
+    const int* A;
+    int p;
+    int r;
+    int min;
+    int* counts; // One counter per key of [min, max]
+} HistogramArgs;
+
+typedef struct {
+    const int* A;
+    int p;
+    int r;
+    int* keys; // Open addressing table of the distinct keys of the chunk
+    int* counts; // Occurrences of every key of the table, 0 for an empty slot
+    int no_keys;
+    bool overflow; // Set when the chunk has more than LOW_CARDINALITY_MAX_KEYS distinct keys
+} HashCountArgs;
+
+typedef struct {
+    int* B;
+    int offset; // Position in B of the first key of the range
+    const int* keys; // Sorted distinct keys, or NULL when the keys are min, min + 1, ...
+    int min;
+    const int* counts;
+    int first;
+    int last;
+} FillArgs;
+
+/**
+ * Sort A into B, taking a fast path when the input has few distinct keys.
+ * Keys spanning a range no wider than n are counted directly; otherwise a
+ * sample of the input estimates the number of distinct keys, and if they fit
+ * in the per-thread hash tables they are counted there. Either way, every
+ * key is then written as one block of equal values. Inputs that fit
+ * neither case are sorted with p_merge_sort.
+ * @param pool The thread pool to use, or NULL to run on the calling thread
+ * @param A The input array, left unmodified
+ * @param n The number of elements in A
+ * @param B The output array, of at least n elements
+ * @return 0 on success, -1 on invalid arguments
+ */
+int p_sort_low_cardinality(ThreadPool* pool, const int* A, int n, int* B);
+
+#endif //P_LOW_CARDINALITY_H
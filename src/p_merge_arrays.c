@@ -0,0 +1,190 @@
+/*
+ * Created by Nikos Ntokos on 24/4/24.
+ * Copyright (c) 2024, Nikos Ntokos
+ * All rights reserved.
+ */
+
+#include "p_merge_arrays.h"
+#include "p_merge_sort.h"
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "verbosity.h"
+
+// Two-pointer merge, used once the recursion no longer hands subtasks to the pool
+static void merge_sequential(const int* X, int p1, int r1, const int* Y, int p2, int r2, int* A, int p3) {
+    while (p1 <= r1 && p2 <= r2) {
+        A[p3++] = (Y[p2] < X[p1]) ? Y[p2++] : X[p1++];
+    }
+    if (p1 <= r1) {
+        memcpy(&A[p3], &X[p1], (r1 - p1 + 1) * sizeof(int));
+    } else if (p2 <= r2) {
+        memcpy(&A[p3], &Y[p2], (r2 - p2 + 1) * sizeof(int));
+    }
+}
+
+void* p_merge_two(void* args) {
+    MergeArraysArgs* mergeArgs = (MergeArraysArgs*) args;
+    const int* X = mergeArgs->X;
+    int p1 = mergeArgs->p1; int r1 = mergeArgs->r1;
+    const int* Y = mergeArgs->Y;
+    int p2 = mergeArgs->p2; int r2 = mergeArgs->r2;
+    int* A = mergeArgs->A;
+    int p3 = mergeArgs->p3;
+    ThreadPool *pool = mergeArgs->pool;
+    int depth = mergeArgs->depth;
+
+    if (pool == NULL || depth > MAX_DEPTH) {
+        merge_sequential(X, p1, r1, Y, p2, r2, A, p3);
+        return NULL;
+    }
+
+    int n1 = r1 - p1 + 1;
+    int n2 = r2 - p2 + 1;
+
+    if (n1 < n2) {
+        const int* temp = X;
+        X = Y;
+        Y = temp;
+        swap(&p1, &p2);
+        swap(&r1, &r2);
+        swap(&n1, &n2);
+    }
+
+    if (n1 == 0) {
+        return NULL;
+    }
+
+    int q1 = (p1 + r1) / 2;
+    int q2 = binary_search(X[q1], Y, p2, r2);
+    int q3 = p3 + (q1 - p1) + (q2 - p2);
+    A[q3] = X[q1];
+
+    MergeArraysArgs left_args = {X, p1, q1 - 1, Y, p2, q2 - 1, A, p3, pool, depth+1};
+    MergeArraysArgs right_args = {X, q1 + 1, r1, Y, q2, r2, A, q3 + 1, pool, depth+1};
+
+    Task left_task = {(void *(*)(void *)) p_merge_two, &left_args};
+    Task right_task = {(void *(*)(void *)) p_merge_two, &right_args};
+
+    int left_status = addTaskFront(pool, &left_task);
+    print_verbosity(DEBUG, "{p_merge_two}: Left status: %d", left_status);
+
+    int right_status = addTaskFront(pool, &right_task);
+    print_verbosity(DEBUG, "{p_merge_two}: Right status: %d", right_status);
+    if (left_status == 0) {
+        waitForTask(pool, &left_task);
+    } else {
+        print_verbosity(DEBUG, "{p_merge_two}: Calling left task on same thread");
+        p_merge_two(&left_args);
+    }
+    if (right_status == 0) {
+        waitForTask(pool, &right_task);
+    } else {
+        print_verbosity(DEBUG, "{p_merge_two}: Calling right task on same thread");
+        p_merge_two(&right_args);
+    }
+    return NULL;
+}
+
+int p_merge_arrays(ThreadPool* pool, const int* X, int nx, const int* Y, int ny, int* out) {
+    if ((X == NULL && nx > 0) || (Y == NULL && ny > 0) || out == NULL || nx < 0 || ny < 0
+        || (long)nx + ny > INT_MAX) {
+        return -1;
+    }
+    MergeArraysArgs args = {X, 0, nx - 1, Y, 0, ny - 1, out, 0, pool, 0};
+    p_merge_two(&args);
+    return 0;
+}
+
+int p_merge_k_arrays(ThreadPool* pool, const int* const* arrays, const int* sizes, int k, int* out) {
+    if (arrays == NULL || sizes == NULL || out == NULL || k < 0) {
+        return -1;
+    }
+    long total = 0; // The output is indexed with int, so the sizes must add up to at most INT_MAX
+    for (int i = 0; i < k; i++) {
+        if (sizes[i] < 0 || (arrays[i] == NULL && sizes[i] > 0)) {
+            return -1;
+        }
+        total += sizes[i];
+        if (total > INT_MAX) {
+            return -1;
+        }
+    }
+    if (k == 0) {
+        return 0;
+    }
+    if (k == 1) {
+        memcpy(out, arrays[0], sizes[0] * sizeof(int));
+        return 0;
+    }
+
+    const int** runs = (const int**)malloc(k * sizeof(int*));
+    int* run_sizes = (int*)malloc(k * sizeof(int));
+    int* buffers[2] = {NULL, NULL};
+    if (k > 2) {
+        buffers[0] = (int*)malloc((size_t)total * sizeof(int));
+        buffers[1] = (int*)malloc((size_t)total * sizeof(int));
+    }
+    if (!runs || !run_sizes || (k > 2 && (!buffers[0] || !buffers[1]))) {
+        fprintf(stderr, "Failed to allocate memory\n");
+        exit(EXIT_FAILURE);
+    }
+    memcpy(runs, arrays, k * sizeof(int*));
+    memcpy(run_sizes, sizes, k * sizeof(int));
+
+    // Merge neighbouring runs pairwise until two are left, alternating between the scratch buffers
+    int no_runs = k;
+    int round = 0;
+    while (no_runs > 2) {
+        int* buffer = buffers[round % 2];
+        int offset = 0;
+        int next = 0;
+        for (int i = 0; i < no_runs; i += 2) {
+            int size = run_sizes[i];
+            if (i + 1 < no_runs) {
+                p_merge_arrays(pool, runs[i], run_sizes[i], runs[i + 1], run_sizes[i + 1], buffer + offset);
+                size += run_sizes[i + 1];
+            } else {
+                memcpy(buffer + offset, runs[i], size * sizeof(int));
+            }
+            runs[next] = buffer + offset;
+            run_sizes[next] = size;
+            offset += size;
+            next++;
+        }
+        no_runs = next;
+        round++;
+    }
+    p_merge_arrays(pool, runs[0], run_sizes[0], runs[1], run_sizes[1], out);
+
+    free(buffers[0]);
+    free(buffers[1]);
+    free(run_sizes);
+    free(runs);
+    return 0;
+}
+
+int p_insert_batch(ThreadPool* pool, const int* A, int n, const int* batch, int m, int* out) {
+    if ((A == NULL && n > 0) || (batch == NULL && m > 0) || out == NULL || n < 0 || m < 0
+        || (long)n + m > INT_MAX) {
+        return -1;
+    }
+    if (m == 0) {
+        memcpy(out, A, n * sizeof(int));
+        return 0;
+    }
+
+    int* sorted = (int*)malloc(m * sizeof(int));
+    if (!sorted) {
+        fprintf(stderr, "Failed to allocate memory\n");
+        exit(EXIT_FAILURE);
+    }
+    // p_merge_sort only reads the batch, the sorted copy goes to its own buffer
+    SortArgs sort_args = {(int*)batch, 0, m - 1, sorted, 0, pool, 0};
+    p_merge_sort(&sort_args);
+
+    p_merge_arrays(pool, A, n, sorted, m, out);
+    free(sorted);
+    return 0;
+}
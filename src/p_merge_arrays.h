@@ -0,0 +1,64 @@
+/*
+ * Created by Nikos Ntokos on 24/4/24.
+ * Copyright (c) 2024, Nikos Ntokos
+ * All rights reserved.
+ */
+
+#ifndef P_MERGE_ARRAYS_H
+#define P_MERGE_ARRAYS_H
+
+#include "multithreading.h"
+
+typedef struct {
+    const int* X;
+    int p1;
+    int r1;
+    const int* Y;
+    int p2;
+    int r2;
+    int* A;
+    int p3;
+    ThreadPool *pool;
+    int depth;
+} MergeArraysArgs;
+
+void* p_merge_two(void* args);
+
+/**
+ * Merge two sorted arrays into out
+ * @param pool The thread pool to use, or NULL to run on the calling thread
+ * @param X The first sorted array
+ * @param nx The number of elements in X
+ * @param Y The second sorted array
+ * @param ny The number of elements in Y
+ * @param out The output array, of at least nx + ny elements, not overlapping X or Y
+ * @return 0 on success, -1 on invalid arguments or an output of more than INT_MAX elements
+ */
+int p_merge_arrays(ThreadPool* pool, const int* X, int nx, const int* Y, int ny, int* out);
+
+/**
+ * Merge k sorted arrays into out, pairwise in log(k) rounds
+ * @param pool The thread pool to use, or NULL to run on the calling thread
+ * @param arrays The sorted arrays
+ * @param sizes The number of elements of each array
+ * @param k The number of arrays
+ * @param out The output array, of at least the sum of sizes elements, not overlapping any input
+ * @return 0 on success, -1 on invalid arguments or an output of more than INT_MAX elements
+ */
+int p_merge_k_arrays(ThreadPool* pool, const int* const* arrays, const int* sizes, int k, int* out);
+
+/**
+ * Insert an unsorted batch into a sorted array. Only the batch is sorted, then
+ * it is merged with A, so the cost is O(n + m log m) instead of a full re-sort.
+ * Callers keeping a large sorted array typically alternate between two buffers.
+ * @param pool The thread pool to use, or NULL to run on the calling thread
+ * @param A The sorted array
+ * @param n The number of elements in A
+ * @param batch The new keys, in any order, left unmodified
+ * @param m The number of keys in the batch
+ * @param out The output array, of at least n + m elements, not overlapping A or batch
+ * @return 0 on success, -1 on invalid arguments or an output of more than INT_MAX elements
+ */
+int p_insert_batch(ThreadPool* pool, const int* A, int n, const int* batch, int m, int* out);
+
+#endif //P_MERGE_ARRAYS_H
@@ -7,23 +7,11 @@
 #include "p_merge_sort.h"
 #include <stdio.h>
 #include <stdlib.h>
-#include <time.h>
-#include <sys/resource.h>
 #include <string.h>
 #include <math.h>
-#include <sys/time.h>
+#include <stdint.h>
 #include "verbosity.h"
 
-#define MAX_THREADS 3
-#define MAX_TASKS_IN_QUEUE 3
-#define MAX_DEPTH 2
-
-#define DEFAULT_ARRAY_SIZE 1000000
-
-#define VERBOSITY_LEVEL SILENT
-
-pthread_mutex_t mutex; // Global mutex variable
-
 int binary_search(int x, const int* arr, int p, int r) {
     // low is the starting index p, and high is the max of p and r+1
     int low = p;
@@ -44,19 +32,72 @@ void swap(int *n1, int *n2) {
     *n2 = temp;
 }
 
-void* p_merge(void* args) {
-    MergeArgs* mergeArgs = (MergeArgs*) args;
-    int* T = mergeArgs->T;
+static int int_search(const void* x, const void* arr, int p, int r) {
+    return binary_search(*(const int*)x, (const int*)arr, p, r);
+}
+
+static void int_merge(const void* T, int p1, int r1, int p2, int r2, void* A, int p3) {
+    const int* in = (const int*)T;
+    int* out = (int*)A;
+    while (p1 <= r1 && p2 <= r2) {
+        out[p3++] = in[p2] < in[p1] ? in[p2++] : in[p1++];
+    }
+    while (p1 <= r1) {
+        out[p3++] = in[p1++];
+    }
+    while (p2 <= r2) {
+        out[p3++] = in[p2++];
+    }
+}
+
+const SortKind int_sort_kind = {sizeof(int), int_search, int_merge, NULL};
+
+// Address of element i of an array of the given kind
+static void* element(const SortKind* kind, const void* arr, int i) {
+    return (char*)arr + (size_t)i * kind->size;
+}
+
+// Copy one element. Every element is placed by one such copy, so the common sizes get a constant-size memcpy the compiler inlines
+static inline void copy_element(const SortKind* kind, void* dst, const void* src) {
+    switch (kind->size) {
+        case sizeof(int):
+            memcpy(dst, src, sizeof(int));
+            break;
+        case 2 * sizeof(uint64_t):
+            memcpy(dst, src, 2 * sizeof(uint64_t));
+            break;
+        case 4 * sizeof(uint64_t):
+            memcpy(dst, src, 4 * sizeof(uint64_t));
+            break;
+        default:
+            memcpy(dst, src, kind->size);
+    }
+}
+
+void* p_merge_kind(void* args) {
+    KindMergeArgs* mergeArgs = (KindMergeArgs*) args;
+    const SortKind* kind = mergeArgs->kind;
+    const void* T = mergeArgs->T;
     int p1 = mergeArgs->p1; int r1 = mergeArgs->r1;
     int p2 = mergeArgs->p2; int r2 = mergeArgs->r2;
-    int* A = mergeArgs->A;
+    void* A = mergeArgs->A;
     int p3 = mergeArgs->p3;
     ThreadPool *pool = mergeArgs->pool;
     int depth = mergeArgs->depth;
+    JobContext* job = mergeArgs->job;
 
     int n1 = r1 - p1 + 1;
     int n2 = r2 - p2 + 1;
 
+    if (n1 + n2 >= CANCEL_CHECK_MIN_SIZE && checkJobCancelled(job)) {
+        return NULL;
+    }
+    // Below the depth where subtasks go to the pool, the kind may have a linear merge that beats splitting
+    if (kind->merge != NULL && (pool == NULL || depth > MAX_DEPTH)) {
+        kind->merge(T, p1, r1, p2, r2, A, p3);
+        return NULL;
+    }
+
     if (n1 < n2) {
         swap(&p1, &p2);
         swap(&r1, &r2);
@@ -66,200 +107,126 @@ void* p_merge(void* args) {
     if (n1 == 0) {
         return NULL;
     } else {
-        int q1 = floor((p1 + r1) / 2);
-        int q2 = binary_search(T[q1], T, p2, r2);
+        int q1 = (p1 + r1) / 2;
+        int q2 = kind->search(element(kind, T, q1), T, p2, r2);
         int q3 = p3 + (q1 - p1) + (q2 - p2);
-        A[q3] = T[q1];
+        copy_element(kind, element(kind, A, q3), element(kind, T, q1));
 
-        MergeArgs left_args = {T, p1, q1 - 1, p2, q2 - 1, A, p3, pool, depth+1};
-        MergeArgs right_args = {T, q1 + 1, r1, q2, r2, A, q3 + 1, pool, depth+1};
+        KindMergeArgs left_args = {kind, T, p1, q1 - 1, p2, q2 - 1, A, p3, pool, depth+1, job};
+        KindMergeArgs right_args = {kind, T, q1 + 1, r1, q2, r2, A, q3 + 1, pool, depth+1, job};
 
         if (pool!=NULL && depth <= MAX_DEPTH) {
-            Task left_task = {(void *(*)(void *)) p_merge, &left_args};
-            Task right_task = {(void *(*)(void *)) p_merge, &right_args};
+            Task left_task = {.function = (void *(*)(void *)) p_merge_kind, .args = &left_args, .priority = jobPriority(job), .job = job};
+            Task right_task = {.function = (void *(*)(void *)) p_merge_kind, .args = &right_args, .priority = jobPriority(job), .job = job};
             print_verbosity(DEBUG, "Left task: %p, Right task: %p", &left_task, &right_task);
 
             int left_status = addTaskFront(pool, &left_task);
-            print_verbosity(DEBUG, "{p_merge}: Left status: %d", left_status);
+            print_verbosity(DEBUG, "{p_merge_kind}: Left status: %d", left_status);
 
             int right_status = addTaskFront(pool, &right_task);
-            print_verbosity(DEBUG, "{p_merge}: Right status: %d", right_status);
+            print_verbosity(DEBUG, "{p_merge_kind}: Right status: %d", right_status);
             if (left_status == 0) {
                 waitForTask(pool, &left_task);
             } else {
-                print_verbosity(DEBUG, "{p_merge}: Calling left task on same thread");
-                p_merge(&left_args);
+                print_verbosity(DEBUG, "{p_merge_kind}: Calling left task on same thread");
+                p_merge_kind(&left_args);
             }
             if (right_status == 0) {
                 waitForTask(pool, &right_task);
             } else {
-                print_verbosity(DEBUG, "{p_merge}: Calling right task on same thread");
-                p_merge(&right_args);
+                print_verbosity(DEBUG, "{p_merge_kind}: Calling right task on same thread");
+                p_merge_kind(&right_args);
             }
         } else {
-            p_merge(&left_args);
-            p_merge(&right_args);
+            p_merge_kind(&left_args);
+            p_merge_kind(&right_args);
+        }
+        // A cancelled job may have left the halves unwritten, and its output is dropped anyway
+        if (kind->join != NULL && !checkJobCancelled(job)) {
+            kind->join(A, p3, q3, p3 + n1 + n2 - 1);
         }
     }
     return NULL;
 }
 
-void* p_merge_sort(void* args) {
-    SortArgs* sortArgs = malloc(sizeof(SortArgs)); // Dynamically allocate memory for arguments
-    memcpy(sortArgs, args, sizeof(SortArgs)); // Copy the arguments to the new memory location
-    int p = sortArgs->p;
-    int r = sortArgs->r;
-    int s = sortArgs->s;
-    int* A = sortArgs->A;
-    int* B = sortArgs->B;
-    ThreadPool *pool = sortArgs->pool;
-    int depth = sortArgs->depth;
+void* p_merge_sort_kind(void* args) {
+    KindSortArgs sortArgs = *(KindSortArgs*) args; // Copy the arguments, the caller's copy may go out of scope
+    const SortKind* kind = sortArgs.kind;
+    int p = sortArgs.p;
+    int r = sortArgs.r;
+    int s = sortArgs.s;
+    void* A = sortArgs.A;
+    void* B = sortArgs.B;
+    ThreadPool *pool = sortArgs.pool;
+    int depth = sortArgs.depth;
+    JobContext* job = sortArgs.job;
 
     int n = r - p + 1;
-    if (n==1) {
-        B[s] = A[p];
+    if (n >= CANCEL_CHECK_MIN_SIZE && checkJobCancelled(job)) {
+        // The job was abandoned, release the thread without sorting
+    } else if (n==1) {
+        copy_element(kind, element(kind, B, s), element(kind, A, p));
     } else {
-        int q = (int)floor((double)(p + r) / 2);
+        int q = (p + r) / 2;
         int q_prime = q-p+1;
-        int* T = (int*)malloc(n * sizeof(int));
+        // A node's temporary is only live between the merges of its children and its own merge, so it can
+        // share an array with its grandchildren, which have merged by then, but not with its children
+        void* scratch = sortArgs.scratch;
+        void* T = scratch != NULL ? element(kind, scratch, p) : malloc((size_t)n * kind->size);
         if (!T) {
             fprintf(stderr, "Failed to allocate memory\n");
             exit(EXIT_FAILURE);
         }
 
-        SortArgs left_args = {A, p, q, T, 0, pool, depth+1};
-        SortArgs right_args = {A, q + 1, r, T, q_prime, pool, depth+1};
+        KindSortArgs left_args = {kind, A, p, q, T, 0, pool, depth+1, job, sortArgs.scratch_alt, scratch};
+        KindSortArgs right_args = {kind, A, q + 1, r, T, q_prime, pool, depth+1, job, sortArgs.scratch_alt, scratch};
 
         if (pool!=NULL && depth <= MAX_DEPTH) {
-            Task left_task = {(void *(*)(void *)) p_merge_sort, &left_args};
-            Task right_task = {(void *(*)(void *)) p_merge_sort, &right_args};
+            Task left_task = {.function = (void *(*)(void *)) p_merge_sort_kind, .args = &left_args, .priority = jobPriority(job), .job = job};
+            Task right_task = {.function = (void *(*)(void *)) p_merge_sort_kind, .args = &right_args, .priority = jobPriority(job), .job = job};
             print_verbosity(DEBUG, "Left task: %p, Right task: %p", &left_task, &right_task);
 
             int left_status = addTaskFront(pool, &left_task);
-            print_verbosity(DEBUG, "{p_merge_sort}: Left status: %d", left_status);
+            print_verbosity(DEBUG, "{p_merge_sort_kind}: Left status: %d", left_status);
 
             int right_status = addTaskFront(pool, &right_task);
-            print_verbosity(DEBUG, "{p_merge_sort}: Right status: %d", right_status);
+            print_verbosity(DEBUG, "{p_merge_sort_kind}: Right status: %d", right_status);
             if (left_status == 0) {
                 waitForTask(pool, &left_task);
             } else {
-                print_verbosity(DEBUG, "{p_merge_sort}: Calling left task on same thread");
-                p_merge_sort(&left_args);
+                print_verbosity(DEBUG, "{p_merge_sort_kind}: Calling left task on same thread");
+                p_merge_sort_kind(&left_args);
             }
             if (right_status == 0) {
                 waitForTask(pool, &right_task);
             } else {
-                print_verbosity(DEBUG, "{p_merge_sort}: Calling right task on same thread");
-                p_merge_sort(&right_args);
+                print_verbosity(DEBUG, "{p_merge_sort_kind}: Calling right task on same thread");
+                p_merge_sort_kind(&right_args);
             }
         } else {
-            p_merge_sort(&left_args);
-            p_merge_sort(&right_args);
+            p_merge_sort_kind(&left_args);
+            p_merge_sort_kind(&right_args);
+        }
+        KindMergeArgs merge_args = {kind, T, 0, q_prime-1, q_prime, n-1, B, s, pool, 0, job};
+        p_merge_kind(&merge_args);
+        if (scratch == NULL) {
+            free(T);
         }
-        MergeArgs merge_args = {T, 0, q_prime-1, q_prime, n-1, B, s, pool, 0};
-        p_merge(&merge_args);
-        free(T);
         T=NULL;
     }
-    free(sortArgs); // Free the dynamically allocated memory when done
-    sortArgs = NULL;
     return NULL;
 }
 
-int main(int argc, char *argv[]) {
-    set_verbosity(VERBOSITY_LEVEL); // Set the verbosity level to DEBUG
-    int array_size = DEFAULT_ARRAY_SIZE;
-    if (argc > 1) {
-        array_size = atoi(argv[1]);
-        if (array_size <= 0) {
-            fprintf(stderr, "{main}: Invalid array size\n");
-            exit(EXIT_FAILURE);
-        }
-    }
-
-    pthread_mutex_init(&mutex, NULL); // Initialize the mutex
-
-    int* A = malloc(array_size * sizeof(int));
-    int* B = malloc(array_size * sizeof(int));
-
-    if (!A || !B) { // Check if memory allocation for B failed
-        print_verbosity(NORMAL, "{main}: Failed to allocate memory for A and/or B\n");
-        exit(EXIT_FAILURE);
-    } else {
-        print_verbosity(NORMAL, "{main}: Memory allocated for A and B\n");
-    }
-
-    // Seed the random number generator
-    srand(time(NULL));
-    // Populate the A with random numbers
-    for (int i = 0; i < array_size; i++) {
-        A[i] = rand() % 100000;
-    }
-
-    // Create the thread pool
-    ThreadPool* pool = createThreadPool(MAX_THREADS, MAX_TASKS_IN_QUEUE);
-
-    // Arguments for initial p_merge_sort
-    SortArgs args = {A, 0, array_size - 1, B, 0, pool, 0};
-    
-    // Create Task for initial p_merge_sort
-    Task initial_task = {(void* (*)(void *)) p_merge_sort, &args};
-    print_verbosity(DEBUG, "Initial task: %p", &initial_task);
-
-    // Initial Benchmark variables
-    struct rusage usage; // Memory usage
-    long initial_memory, final_memory; // Memory usage variables
-    clock_t start_cpu, end_cpu; // CPU time variables
-    struct timeval start, end; // Wall time variables
-
-    // Get the initial memory usage
-    getrusage(RUSAGE_SELF, &usage);
-    initial_memory = usage.ru_maxrss;
-
-    // Start the timer
-    start_cpu = clock();
-
-    // Time of day start
-    gettimeofday(&start, NULL);
-
-//    Add the initial task to the thread pool
-    addTaskFront(pool, &initial_task);
-    waitForTask(pool, &initial_task); // Wait for the initial task to finish
-
-    // Time of day end
-    gettimeofday(&end, NULL);
-
-    // Stop the timer
-    end_cpu = clock();
-
-    // Get the final memory usage
-    getrusage(RUSAGE_SELF, &usage);
-    final_memory = usage.ru_maxrss;
-
-    // Destroy the thread pool
-    destroyThreadPool(pool);
-
-    // Output the sorted B
-//    int as = array_size < 100 ? array_size : 100;
-//    for (int i = 0; i < as; i++) {
-//        printf("%d ", A[i]);
-//    }
-//    printf("\n");
-//    for (int i = 0; i < as; i++) {
-//        printf("%d ", B[i]);
-//    }
-//    printf("\n");
-    free(A);
-    free(B);
-
-    // Calculate the time taken and memory used
-    double wall_time = (double) (end.tv_usec - start.tv_usec) / 1000000 + (double) (end.tv_sec - start.tv_sec);
-    double cpu_time = ((double) end_cpu - start_cpu) / CLOCKS_PER_SEC;
-    long memory_used = final_memory - initial_memory;
-
-    printf("Wall Time: %f seconds\n", wall_time);
-    printf("CPU Time: %f seconds\n", cpu_time);
-    printf("Memory used: %ld kilobytes\n", memory_used);
+void* p_merge(void* args) {
+    MergeArgs* mergeArgs = (MergeArgs*) args;
+    KindMergeArgs kind_args = {&int_sort_kind, mergeArgs->T, mergeArgs->p1, mergeArgs->r1, mergeArgs->p2, mergeArgs->r2,
+                               mergeArgs->A, mergeArgs->p3, mergeArgs->pool, mergeArgs->depth, mergeArgs->job};
+    return p_merge_kind(&kind_args);
+}
 
-    return 0;
-}
\ No newline at end of file
+void* p_merge_sort(void* args) {
+    SortArgs* sortArgs = (SortArgs*) args;
+    KindSortArgs kind_args = {&int_sort_kind, sortArgs->A, sortArgs->p, sortArgs->r, sortArgs->B, sortArgs->s,
+                              sortArgs->pool, sortArgs->depth, sortArgs->job, sortArgs->scratch, sortArgs->scratch_alt};
+    return p_merge_sort_kind(&kind_args);
+}
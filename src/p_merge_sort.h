@@ -8,8 +8,12 @@
 #define P_MERGE_SORT_H
 
 #include <pthread.h>
+#include <stddef.h>
 #include "multithreading.h"
 
+#define MAX_DEPTH 2 // Recursion depth down to which subtasks are offered to the thread pool
+#define CANCEL_CHECK_MIN_SIZE 1024 // Smaller subproblems finish without polling their job for cancellation
+
 typedef struct {
     int* A;
     int p;
@@ -18,6 +22,11 @@ typedef struct {
     int s;
     ThreadPool* pool;
     int depth;
+    JobContext* job; // The job the sort belongs to, or NULL
+    // Optional scratch arena: two arrays indexed like A, with r + 1 elements each. Nodes of even and odd
+    // depth take their temporary from alternate arrays, so a sort needs no allocation. NULL to allocate per node
+    int* scratch;
+    int* scratch_alt;
 } SortArgs;
 
 typedef struct {
@@ -30,11 +39,69 @@ typedef struct {
     int p3;
     ThreadPool *pool;
     int depth;
+    JobContext* job; // The job the merge belongs to, or NULL
 } MergeArgs;
 
+/*
+ * Element type of the shared merge sort recursion. The recursion only moves
+ * elements as blocks of size bytes, everything that depends on their type
+ * goes through these functions.
+ */
+typedef struct {
+    size_t size; // Bytes per element
+    // Like binary_search: the position of the first element of the sorted arr[p..r] that does not sort before x
+    int (*search)(const void* x, const void* arr, int p, int r);
+    // Sequential merge of T[p1..r1] and T[p2..r2] into A from p3, used where no subtask is offered to the
+    // pool. NULL to keep splitting by binary search down to single elements
+    void (*merge)(const void* T, int p1, int r1, int p2, int r2, void* A, int p3);
+    // Called once both halves of a split merge are done, with the output range [p3, r3] and the position q3
+    // of the element it was split at. NULL if the output needs no fix up
+    void (*join)(void* A, int p3, int q3, int r3);
+} SortKind;
+
+typedef struct {
+    const SortKind* kind;
+    void* A;
+    int p;
+    int r;
+    void* B;
+    int s;
+    ThreadPool* pool;
+    int depth;
+    JobContext* job;
+    void* scratch; // Same as in SortArgs, with elements of kind->size bytes
+    void* scratch_alt;
+} KindSortArgs;
+
+typedef struct {
+    const SortKind* kind;
+    const void* T;
+    int p1;
+    int r1;
+    int p2;
+    int r2;
+    void* A;
+    int p3;
+    ThreadPool *pool;
+    int depth;
+    JobContext* job;
+} KindMergeArgs;
+
+extern const SortKind int_sort_kind;
+
 int binary_search(int x, const int* arr, int p, int r);
 void swap(int *n1, int *n2);
 
+/**
+ * Merge two sorted runs of any kind, see KindMergeArgs. The task function every merge goes through
+ */
+void* p_merge_kind(void* args);
+
+/**
+ * Merge sort A[p..r] of any kind into B from s, see KindSortArgs. The task function every sort goes through
+ */
+void* p_merge_sort_kind(void* args);
+
 void* p_merge(void* args);
 void* p_merge_sort(void* args);
 
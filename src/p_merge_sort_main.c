@@ -0,0 +1,120 @@
+/*
+ * Created by Nikos Ntokos on 24/4/24.
+ * Copyright (c) 2024, Nikos Ntokos
+ * All rights reserved.
+ */
+
+#include "p_merge_sort.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <sys/resource.h>
+#include <sys/time.h>
+#include "verbosity.h"
+
+#define MAX_THREADS 3
+#define MAX_TASKS_IN_QUEUE 3
+
+#define DEFAULT_ARRAY_SIZE 1000000
+
+#define VERBOSITY_LEVEL SILENT
+
+pthread_mutex_t mutex; // Global mutex variable
+
+int main(int argc, char *argv[]) {
+    set_verbosity(VERBOSITY_LEVEL); // Set the verbosity level to DEBUG
+    int array_size = DEFAULT_ARRAY_SIZE;
+    if (argc > 1) {
+        array_size = atoi(argv[1]);
+        if (array_size <= 0) {
+            fprintf(stderr, "{main}: Invalid array size\n");
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    pthread_mutex_init(&mutex, NULL); // Initialize the mutex
+
+    int* A = malloc(array_size * sizeof(int));
+    int* B = malloc(array_size * sizeof(int));
+
+    if (!A || !B) { // Check if memory allocation for B failed
+        print_verbosity(NORMAL, "{main}: Failed to allocate memory for A and/or B\n");
+        exit(EXIT_FAILURE);
+    } else {
+        print_verbosity(NORMAL, "{main}: Memory allocated for A and B\n");
+    }
+
+    // Seed the random number generator
+    srand(time(NULL));
+    // Populate the A with random numbers
+    for (int i = 0; i < array_size; i++) {
+        A[i] = rand() % 100000;
+    }
+
+    // Create the thread pool
+    ThreadPool* pool = createThreadPool(MAX_THREADS, MAX_TASKS_IN_QUEUE);
+
+    // Arguments for initial p_merge_sort
+    SortArgs args = {A, 0, array_size - 1, B, 0, pool, 0};
+    
+    // Create Task for initial p_merge_sort
+    Task initial_task = {(void* (*)(void *)) p_merge_sort, &args};
+    print_verbosity(DEBUG, "Initial task: %p", &initial_task);
+
+    // Initial Benchmark variables
+    struct rusage usage; // Memory usage
+    long initial_memory, final_memory; // Memory usage variables
+    clock_t start_cpu, end_cpu; // CPU time variables
+    struct timeval start, end; // Wall time variables
+
+    // Get the initial memory usage
+    getrusage(RUSAGE_SELF, &usage);
+    initial_memory = usage.ru_maxrss;
+
+    // Start the timer
+    start_cpu = clock();
+
+    // Time of day start
+    gettimeofday(&start, NULL);
+
+//    Add the initial task to the thread pool
+    addTaskFront(pool, &initial_task);
+    waitForTask(pool, &initial_task); // Wait for the initial task to finish
+
+    // Time of day end
+    gettimeofday(&end, NULL);
+
+    // Stop the timer
+    end_cpu = clock();
+
+    // Get the final memory usage
+    getrusage(RUSAGE_SELF, &usage);
+    final_memory = usage.ru_maxrss;
+
+    // Destroy the thread pool
+    destroyThreadPool(pool);
+
+    // Output the sorted B
+//    int as = array_size < 100 ? array_size : 100;
+//    for (int i = 0; i < as; i++) {
+//        printf("%d ", A[i]);
+//    }
+//    printf("\n");
+//    for (int i = 0; i < as; i++) {
+//        printf("%d ", B[i]);
+//    }
+//    printf("\n");
+    free(A);
+    free(B);
+
+    // Calculate the time taken and memory used
+    double wall_time = (double) (end.tv_usec - start.tv_usec) / 1000000 + (double) (end.tv_sec - start.tv_sec);
+    double cpu_time = ((double) end_cpu - start_cpu) / CLOCKS_PER_SEC;
+    long memory_used = final_memory - initial_memory;
+
+    printf("Wall Time: %f seconds\n", wall_time);
+    printf("CPU Time: %f seconds\n", cpu_time);
+    printf("Memory used: %ld kilobytes\n", memory_used);
+
+    return 0;
+}
\ No newline at end of file
@@ -0,0 +1,372 @@
+/*
+ * Created by Nikos Ntokos on 24/4/24.
+ * Copyright (c) 2024, Nikos Ntokos
+ * All rights reserved.
+ */
+
+#include "p_select.h"
+#include "p_merge_sort.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "verbosity.h"
+
+#define SELECT_SEQUENTIAL_CUTOFF 4096 // Below this size the selection finishes on the calling thread
+#define SELECT_SAMPLE_SIZE 1024 // Number of elements sampled to bracket the requested rank
+#define SELECT_MIN_CHUNK 16384 // Minimum number of elements scanned by one task
+
+static int compare_ints(const void* a, const void* b) {
+    int x = *(const int*)a;
+    int y = *(const int*)b;
+    return (x > y) - (x < y);
+}
+
+static int median_of_three(int a, int b, int c) {
+    if (a < b) {
+        return b < c ? b : (a < c ? c : a);
+    }
+    return a < c ? a : (b < c ? c : b);
+}
+
+static void* check_alloc(void* ptr) {
+    if (!ptr) {
+        fprintf(stderr, "Failed to allocate memory\n");
+        exit(EXIT_FAILURE);
+    }
+    return ptr;
+}
+
+// Number of chunks a scan over n elements is split into
+static int no_chunks(ThreadPool* pool, int n) {
+    if (pool == NULL) {
+        return 1;
+    }
+    int chunks = pool->max_threads + 1; // The calling thread takes the chunks the queue rejects
+    int max_chunks = n / SELECT_MIN_CHUNK;
+    if (chunks > max_chunks) {
+        chunks = max_chunks;
+    }
+    return chunks < 1 ? 1 : chunks;
+}
+
+static void* count_chunk(void* args) {
+    CountArgs* countArgs = (CountArgs*) args;
+    const int* A = countArgs->A;
+    int lo = countArgs->lo;
+    int hi = countArgs->hi;
+    int less = 0;
+    int greater = 0;
+
+    for (int i = countArgs->p; i <= countArgs->r; i++) {
+        less += A[i] < lo;
+        greater += A[i] > hi;
+    }
+    countArgs->less = less;
+    countArgs->greater = greater;
+    return NULL;
+}
+
+static void* gather_chunk(void* args) {
+    GatherArgs* gatherArgs = (GatherArgs*) args;
+    const int* A = gatherArgs->A;
+    int lo = gatherArgs->lo;
+    int hi = gatherArgs->hi;
+    int* less = gatherArgs->less;
+    int* band = gatherArgs->band;
+    int* greater = gatherArgs->greater;
+
+    for (int i = gatherArgs->p; i <= gatherArgs->r; i++) {
+        int x = A[i];
+        if (x < lo) {
+            if (less) *less++ = x;
+        } else if (x > hi) {
+            if (greater) *greater++ = x;
+        } else if (band) {
+            *band++ = x;
+        }
+    }
+    return NULL;
+}
+
+// Count, per chunk of A, the elements smaller than lo and greater than hi
+static void count_buckets(ThreadPool* pool, const int* A, int n, int lo, int hi, CountArgs* counts, int chunks) {
+    Task* tasks = check_alloc(calloc(chunks, sizeof(Task)));
+    for (int c = 0; c < chunks; c++) {
+        int p = (int)((long)n * c / chunks);
+        int r = (int)((long)n * (c + 1) / chunks) - 1;
+        CountArgs chunk_args = {A, p, r, lo, hi, 0, 0};
+        counts[c] = chunk_args;
+        tasks[c].function = count_chunk;
+        tasks[c].args = &counts[c];
+    }
+    runTasks(pool, tasks, chunks);
+    free(tasks);
+}
+
+// Copy the requested buckets of every chunk counted by count_buckets to their destination, keeping the input order
+static void gather_buckets(ThreadPool* pool, const CountArgs* counts, int chunks, int* less, int* band, int* greater) {
+    GatherArgs* gathers = check_alloc(malloc(chunks * sizeof(GatherArgs)));
+    Task* tasks = check_alloc(calloc(chunks, sizeof(Task)));
+    int less_offset = 0;
+    int band_offset = 0;
+    int greater_offset = 0;
+
+    for (int c = 0; c < chunks; c++) {
+        const CountArgs* count = &counts[c];
+        int in_band = count->r - count->p + 1 - count->less - count->greater;
+        GatherArgs chunk_args = {count->A, count->p, count->r, count->lo, count->hi,
+                                 less ? less + less_offset : NULL,
+                                 band ? band + band_offset : NULL,
+                                 greater ? greater + greater_offset : NULL};
+        gathers[c] = chunk_args;
+        less_offset += count->less;
+        band_offset += in_band;
+        greater_offset += count->greater;
+        tasks[c].function = gather_chunk;
+        tasks[c].args = &gathers[c];
+    }
+    runTasks(pool, tasks, chunks);
+    free(tasks);
+    free(gathers);
+}
+
+// Three-way partition of A[p..r]: A[p..lt-1] < pivot, A[lt..gt] == pivot, A[gt+1..r] > pivot
+static void partition3(int* A, int p, int r, int pivot, int* lt, int* gt) {
+    int l = p;
+    int i = p;
+    int g = r;
+    while (i <= g) {
+        if (A[i] < pivot) {
+            swap(&A[l++], &A[i++]);
+        } else if (A[i] > pivot) {
+            swap(&A[i], &A[g--]);
+        } else {
+            i++;
+        }
+    }
+    *lt = l;
+    *gt = g;
+}
+
+// Sequential quickselect, leaves A[p..r] partitioned around rank k
+static void quickselect(int* A, int p, int r, int k) {
+    while (p < r) {
+        int pivot = median_of_three(A[p], A[p + (r - p) / 2], A[r]);
+        int lt, gt;
+        partition3(A, p, r, pivot, &lt, &gt);
+        if (k < lt) {
+            r = lt - 1;
+        } else if (k > gt) {
+            p = gt + 1;
+        } else {
+            return;
+        }
+    }
+}
+
+int p_select(ThreadPool* pool, const int* A, int n, int k, int* value) {
+    if (A == NULL || value == NULL || k < 0 || k >= n) {
+        return -1;
+    }
+
+    const int* current = A;
+    int* owned = NULL; // Candidate buffer owned by this call, NULL while scanning the input itself
+    int m = n;
+    int sample[SELECT_SAMPLE_SIZE];
+    int delta = (int)sqrt(SELECT_SAMPLE_SIZE);
+
+    while (m > SELECT_SEQUENTIAL_CUTOFF) {
+        // Bracket rank k between two sampled values, then keep only the bucket that contains it
+        for (int i = 0; i < SELECT_SAMPLE_SIZE; i++) {
+            sample[i] = current[(long)i * m / SELECT_SAMPLE_SIZE];
+        }
+        qsort(sample, SELECT_SAMPLE_SIZE, sizeof(int), compare_ints);
+        int pos = (int)((long)k * SELECT_SAMPLE_SIZE / m);
+        int lo = sample[pos - delta < 0 ? 0 : pos - delta];
+        int hi = sample[pos + delta >= SELECT_SAMPLE_SIZE ? SELECT_SAMPLE_SIZE - 1 : pos + delta];
+
+        int chunks = no_chunks(pool, m);
+        CountArgs* counts = check_alloc(malloc(chunks * sizeof(CountArgs)));
+        count_buckets(pool, current, m, lo, hi, counts, chunks);
+        int less = 0;
+        int greater = 0;
+        for (int c = 0; c < chunks; c++) {
+            less += counts[c].less;
+            greater += counts[c].greater;
+        }
+        int band = m - less - greater;
+        print_verbosity(DEBUG, "{p_select}: m: %d k: %d lo: %d hi: %d buckets: %d/%d/%d", m, k, lo, hi, less, band, greater);
+
+        if (k >= less && k < less + band && lo == hi) {
+            // Every element of the band is equal, no need to look any further
+            free(counts);
+            free(owned);
+            *value = lo;
+            return 0;
+        }
+
+        int next_m;
+        int* next;
+        if (k < less) {
+            next_m = less;
+        } else if (k >= less + band) {
+            next_m = greater;
+        } else {
+            next_m = band;
+        }
+        if (next_m == m) {
+            // The sample did not split the candidates, finish sequentially
+            free(counts);
+            break;
+        }
+        next = check_alloc(malloc(next_m * sizeof(int)));
+        if (k < less) {
+            gather_buckets(pool, counts, chunks, next, NULL, NULL);
+        } else if (k >= less + band) {
+            gather_buckets(pool, counts, chunks, NULL, NULL, next);
+            k -= less + band;
+        } else {
+            gather_buckets(pool, counts, chunks, NULL, next, NULL);
+            k -= less;
+        }
+        free(counts);
+        free(owned);
+        owned = next;
+        current = next;
+        m = next_m;
+    }
+
+    if (owned == NULL) {
+        owned = check_alloc(malloc(m * sizeof(int)));
+        memcpy(owned, current, m * sizeof(int));
+    }
+    quickselect(owned, 0, m - 1, k);
+    *value = owned[k];
+    free(owned);
+    return 0;
+}
+
+int p_nth_element(ThreadPool* pool, int* A, int n, int k) {
+    if (A == NULL || k < 0 || k >= n) {
+        return -1;
+    }
+
+    int chunks = no_chunks(pool, n);
+    if (chunks == 1) {
+        quickselect(A, 0, n - 1, k);
+        return 0;
+    }
+
+    int value;
+    p_select(pool, A, n, k, &value);
+
+    // Three-way partition around the selected value through a scratch buffer
+    CountArgs* counts = check_alloc(malloc(chunks * sizeof(CountArgs)));
+    count_buckets(pool, A, n, value, value, counts, chunks);
+    int less = 0;
+    int greater = 0;
+    for (int c = 0; c < chunks; c++) {
+        less += counts[c].less;
+        greater += counts[c].greater;
+    }
+    int* T = check_alloc(malloc(n * sizeof(int)));
+    gather_buckets(pool, counts, chunks, T, T + less, T + n - greater);
+    memcpy(A, T, n * sizeof(int));
+    free(T);
+    free(counts);
+    return 0;
+}
+
+int p_top_k(ThreadPool* pool, const int* A, int n, int k, int* out) {
+    if (A == NULL || out == NULL || k < 0 || k > n) {
+        return -1;
+    }
+    if (k == 0) {
+        return 0;
+    }
+
+    int value;
+    p_select(pool, A, n, k - 1, &value);
+
+    // Collect everything strictly below the k-th value, the remaining slots all hold the k-th value itself
+    int chunks = no_chunks(pool, n);
+    CountArgs* counts = check_alloc(malloc(chunks * sizeof(CountArgs)));
+    count_buckets(pool, A, n, value, value, counts, chunks);
+    int less = 0;
+    for (int c = 0; c < chunks; c++) {
+        less += counts[c].less;
+    }
+    gather_buckets(pool, counts, chunks, out, NULL, NULL);
+    free(counts);
+    for (int i = less; i < k; i++) {
+        out[i] = value;
+    }
+
+    // Only the k candidates are sorted
+    if (less > 1) {
+        int* T = check_alloc(malloc(less * sizeof(int)));
+        SortArgs args = {out, 0, less - 1, T, 0, pool, 0};
+        p_merge_sort(&args);
+        memcpy(out, T, less * sizeof(int));
+        free(T);
+    }
+    return 0;
+}
+
+// Resolve the ranks order[lo..hi] (ascending, all within A[p..r]) by recursive nth_element calls
+static void multiselect(ThreadPool* pool, int* A, int p, int r, const int* ranks, const int* order, int lo, int hi, int* out) {
+    if (lo > hi) {
+        return;
+    }
+    int mid = (lo + hi) / 2;
+    int rank = ranks[order[mid]];
+    p_nth_element(pool, A + p, r - p + 1, rank - p);
+
+    int i = mid;
+    while (i >= lo && ranks[order[i]] == rank) {
+        out[order[i--]] = A[rank];
+    }
+    int j = mid + 1;
+    while (j <= hi && ranks[order[j]] == rank) {
+        out[order[j++]] = A[rank];
+    }
+    multiselect(pool, A, p, rank - 1, ranks, order, lo, i, out);
+    multiselect(pool, A, rank + 1, r, ranks, order, j, hi, out);
+}
+
+int p_quantiles(ThreadPool* pool, const int* A, int n, const double* q, int m, int* out) {
+    if (A == NULL || q == NULL || out == NULL || n <= 0 || m < 0) {
+        return -1;
+    }
+    for (int i = 0; i < m; i++) {
+        if (!(q[i] >= 0.0 && q[i] <= 1.0)) {
+            return -1;
+        }
+    }
+    if (m == 0) {
+        return 0;
+    }
+
+    int* ranks = check_alloc(malloc(m * sizeof(int)));
+    int* order = check_alloc(malloc(m * sizeof(int)));
+    for (int i = 0; i < m; i++) {
+        ranks[i] = (int)floor(q[i] * (n - 1));
+        // Insertion sort of the quantile indices by rank, m is expected to be small
+        int j = i;
+        while (j > 0 && ranks[order[j - 1]] > ranks[i]) {
+            order[j] = order[j - 1];
+            j--;
+        }
+        order[j] = i;
+    }
+
+    int* C = check_alloc(malloc(n * sizeof(int)));
+    memcpy(C, A, n * sizeof(int));
+    multiselect(pool, C, 0, n - 1, ranks, order, 0, m - 1, out);
+
+    free(C);
+    free(order);
+    free(ranks);
+    return 0;
+}
@@ -0,0 +1,79 @@
+/*
+ * Created by Nikos Ntokos on 24/4/24.
+ * Copyright (c) 2024, Nikos Ntokos
+ * All rights reserved.
+ */
+
+#ifndef P_SELECT_H
+#define P_SELECT_H
+
+#include "multithreading.h"
+
+typedef struct {
+    const int* A;
+    int p;
+    int r;
+    int lo;
+    int hi;
+    int less; // Number of elements smaller than lo
+    int greater; // Number of elements greater than hi
+} CountArgs;
+
+typedef struct {
+    const int* A;
+    int p;
+    int r;
+    int lo;
+    int hi;
+    int* less; // Destination of the elements smaller than lo (NULL to skip them)
+    int* band; // Destination of the elements in [lo, hi] (NULL to skip them)
+    int* greater; // Destination of the elements greater than hi (NULL to skip them)
+} GatherArgs;
+
+/**
+ * Find the value of rank k (0-based) of A without modifying A
+ * @param pool The thread pool to use, or NULL to run on the calling thread
+ * @param A The input array
+ * @param n The number of elements in A
+ * @param k The rank to select, 0 <= k < n
+ * @param value Where the selected value is stored
+ * @return 0 on success, -1 on invalid arguments
+ */
+int p_select(ThreadPool* pool, const int* A, int n, int k, int* value);
+
+/**
+ * Reorder A so that A[k] holds the value of rank k, every element before it is
+ * smaller or equal and every element after it is greater or equal
+ * @param pool The thread pool to use, or NULL to run on the calling thread
+ * @param A The array to reorder
+ * @param n The number of elements in A
+ * @param k The rank to place, 0 <= k < n
+ * @return 0 on success, -1 on invalid arguments
+ */
+int p_nth_element(ThreadPool* pool, int* A, int n, int k);
+
+/**
+ * Store the k smallest elements of A in ascending order in out
+ * @param pool The thread pool to use, or NULL to run on the calling thread
+ * @param A The input array, left unmodified
+ * @param n The number of elements in A
+ * @param k The number of elements to extract, 0 <= k <= n
+ * @param out The output array, of at least k elements
+ * @return 0 on success, -1 on invalid arguments
+ */
+int p_top_k(ThreadPool* pool, const int* A, int n, int k, int* out);
+
+/**
+ * Extract several quantiles of A in one call. The quantile q maps to the
+ * element of rank floor(q * (n - 1))
+ * @param pool The thread pool to use, or NULL to run on the calling thread
+ * @param A The input array, left unmodified
+ * @param n The number of elements in A
+ * @param q The quantiles to extract, each in [0, 1]
+ * @param m The number of quantiles
+ * @param out The output array, out[i] receives the value of quantile q[i]
+ * @return 0 on success, -1 on invalid arguments
+ */
+int p_quantiles(ThreadPool* pool, const int* A, int n, const double* q, int m, int* out);
+
+#endif //P_SELECT_H
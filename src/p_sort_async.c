@@ -0,0 +1,232 @@
+/*
+ * Created by Nikos Ntokos on 24/4/24.
+ * Copyright (c) 2024, Nikos Ntokos
+ * All rights reserved.
+ */
+
+#include "p_sort_async.h"
+#include <errno.h>
+#include <stdint.h>
+#include <sys/eventfd.h>
+#include "verbosity.h"
+
+static void* run_sort(void* args) {
+    SortFuture* future = (SortFuture*) args;
+    if (future->args.r >= future->args.p) {
+        p_merge_sort(&future->args);
+    }
+    return NULL;
+}
+
+// Task hook, runs on the worker thread once the pool is done with the task
+static void complete_sort(Task* task) {
+    SortFuture* future = (SortFuture*) task->args;
+    SortExecutor* executor = future->executor;
+    future->cancelled = isJobStopped(&future->job);
+
+    if (future->callback != NULL) {
+        future->callback(future, future->cancelled ? ASYNC_SORT_CANCELLED : ASYNC_SORT_DONE, future->user_data);
+        pthread_mutex_lock(&executor->mutex);
+    } else {
+        pthread_mutex_lock(&executor->mutex);
+        future->next = NULL;
+        if (executor->completed_tail == NULL) {
+            executor->completed = future;
+        } else {
+            executor->completed_tail->next = future;
+        }
+        executor->completed_tail = future;
+        uint64_t one = 1;
+        if (write(executor->event_fd, &one, sizeof(one)) != sizeof(one)) {
+            print_verbosity(DEBUG, "{complete_sort}: eventfd write failed: %d", errno);
+        }
+    }
+    // Last touch of the future, another thread may free it as soon as it sees done
+    atomic_store(&future->done, true);
+    executor->in_flight--;
+    pthread_cond_broadcast(&executor->done_cond);
+    pthread_mutex_unlock(&executor->mutex);
+}
+
+// Pool listener, a slot of the pool was freed so the dispatcher can retry the pending sorts
+static void wake_dispatcher(void* args) {
+    SortExecutor* executor = (SortExecutor*) args;
+    pthread_mutex_lock(&executor->mutex);
+    pthread_cond_signal(&executor->cond);
+    pthread_mutex_unlock(&executor->mutex);
+}
+
+static void* dispatch(void* args) {
+    SortExecutor* executor = (SortExecutor*) args;
+
+    pthread_mutex_lock(&executor->mutex);
+    while (!executor->stopping || executor->pending != NULL) {
+        while (executor->pending != NULL && addTaskFront(executor->pool, &executor->pending->task) == 0) {
+            print_verbosity(DEBUG, "{dispatch}: Started sort %p", executor->pending);
+            executor->pending = executor->pending->next;
+        }
+        // Woken by a submission, by stopping, or by the pool once any of its tasks finishes
+        if (executor->pending != NULL || !executor->stopping) {
+            pthread_cond_wait(&executor->cond, &executor->mutex);
+        }
+    }
+    pthread_mutex_unlock(&executor->mutex);
+    return NULL;
+}
+
+SortExecutor* createSortExecutor(ThreadPool* pool) {
+    SortExecutor* executor = (SortExecutor*)calloc(1, sizeof(SortExecutor));
+    if (executor == NULL) {
+        fprintf(stderr, "Failed to allocate memory\n");
+        exit(EXIT_FAILURE);
+    }
+    executor->pool = pool;
+    executor->event_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (executor->event_fd < 0) {
+        fprintf(stderr, "{createSortExecutor}: Failed to create eventfd\n");
+        free(executor);
+        return NULL;
+    }
+    pthread_mutex_init(&executor->mutex, NULL);
+    pthread_cond_init(&executor->cond, NULL);
+    pthread_cond_init(&executor->done_cond, NULL);
+    executor->listener = (PoolListener){.function = wake_dispatcher, .arg = executor};
+    addPoolListener(pool, &executor->listener);
+
+    if (pthread_create(&executor->dispatcher, NULL, dispatch, executor) != 0) {
+        fprintf(stderr, "{createSortExecutor}: Failed to create dispatcher thread\n");
+        removePoolListener(pool, &executor->listener);
+        close(executor->event_fd);
+        free(executor);
+        return NULL;
+    }
+    return executor;
+}
+
+void destroySortExecutor(SortExecutor* executor) {
+    pthread_mutex_lock(&executor->mutex);
+    executor->stopping = true;
+    pthread_cond_signal(&executor->cond);
+    pthread_mutex_unlock(&executor->mutex);
+    pthread_join(executor->dispatcher, NULL); // Returns once every pending sort is in the pool
+
+    pthread_mutex_lock(&executor->mutex);
+    while (executor->in_flight > 0) {
+        pthread_cond_wait(&executor->done_cond, &executor->mutex);
+    }
+    pthread_mutex_unlock(&executor->mutex);
+    removePoolListener(executor->pool, &executor->listener);
+
+    close(executor->event_fd);
+    pthread_mutex_destroy(&executor->mutex);
+    pthread_cond_destroy(&executor->cond);
+    pthread_cond_destroy(&executor->done_cond);
+    free(executor);
+}
+
+int sortExecutorEventFd(SortExecutor* executor) {
+    return executor->event_fd;
+}
+
+SortFuture* submitSort(SortExecutor* executor, const int* A, int n, int* B, int priority, double timeout,
+                       SortCallback callback, void* user_data) {
+    // The same checks as the sort server, so that a bad request never reaches the pool
+    if (executor == NULL || n < 0 || (n > 0 && (A == NULL || B == NULL))) {
+        print_verbosity(DEBUG, "{submitSort}: Rejected a sort of %d elements", n);
+        return NULL;
+    }
+    SortFuture* future = (SortFuture*)calloc(1, sizeof(SortFuture));
+    if (future == NULL) {
+        fprintf(stderr, "Failed to allocate memory\n");
+        exit(EXIT_FAILURE);
+    }
+    initJobContext(&future->job, priority, timeout);
+    future->args = (SortArgs){(int*)A, 0, n - 1, B, 0, executor->pool, 0, &future->job}; // p_merge_sort only reads A
+    future->task = (Task){.function = run_sort, .args = future, .priority = future->job.priority,
+                          .job = &future->job, .on_done = complete_sort};
+    future->executor = executor;
+    future->callback = callback;
+    future->user_data = user_data;
+    atomic_init(&future->done, false);
+
+    // The dispatcher starts it, after the pending sorts of the same or a higher priority
+    pthread_mutex_lock(&executor->mutex);
+    SortFuture** link = &executor->pending;
+    while (*link != NULL && (*link)->job.priority <= future->job.priority) {
+        link = &(*link)->next;
+    }
+    future->next = *link;
+    *link = future;
+    executor->in_flight++;
+    pthread_cond_signal(&executor->cond);
+    pthread_mutex_unlock(&executor->mutex);
+
+    print_verbosity(DEBUG, "{submitSort}: Submitted sort %p of %d elements", future, n);
+    return future;
+}
+
+SortFuture* takeCompletedSort(SortExecutor* executor) {
+    pthread_mutex_lock(&executor->mutex);
+    SortFuture* future = executor->completed;
+    if (future != NULL) {
+        executor->completed = future->next;
+        if (executor->completed == NULL) {
+            executor->completed_tail = NULL;
+        }
+        future->next = NULL;
+    }
+    pthread_mutex_unlock(&executor->mutex);
+    return future;
+}
+
+AsyncSortState getSortState(SortFuture* future) {
+    if (!atomic_load(&future->done)) {
+        return ASYNC_SORT_PENDING;
+    }
+    return future->cancelled ? ASYNC_SORT_CANCELLED : ASYNC_SORT_DONE;
+}
+
+AsyncSortState waitForSort(SortFuture* future) {
+    SortExecutor* executor = future->executor;
+    pthread_mutex_lock(&executor->mutex);
+    while (!atomic_load(&future->done)) {
+        pthread_cond_wait(&executor->done_cond, &executor->mutex);
+    }
+    pthread_mutex_unlock(&executor->mutex);
+    return getSortState(future);
+}
+
+void cancelSort(SortFuture* future) {
+    cancelJob(&future->job);
+}
+
+void freeSortFuture(SortFuture* future) {
+    if (future == NULL) {
+        return;
+    }
+    SortExecutor* executor = future->executor;
+    if (!atomic_load(&future->done)) {
+        cancelSort(future);
+        waitForSort(future);
+    }
+
+    // A completed sort nobody took is still linked in the completed list
+    pthread_mutex_lock(&executor->mutex);
+    SortFuture* previous = NULL;
+    for (SortFuture* current = executor->completed; current != NULL; current = current->next) {
+        if (current == future) {
+            if (previous == NULL) {
+                executor->completed = current->next;
+            } else {
+                previous->next = current->next;
+            }
+            if (executor->completed_tail == current) {
+                executor->completed_tail = previous;
+            }
+            break;
+        }
+        previous = current;
+    }
+    pthread_mutex_unlock(&executor->mutex);
+    free(future);
+}
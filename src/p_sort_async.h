@@ -0,0 +1,131 @@
+/*
+ * Created by Nikos Ntokos on 24/4/24.
+ * Copyright (c) 2024, Nikos Ntokos
+ * All rights reserved.
+ */
+
+/*
+ * Non-blocking front end of p_merge_sort. submitSort() returns a SortFuture
+ * right away and the sort runs on the pool's workers. Its completion can be
+ * polled, delivered to a callback on the worker thread, or signalled through
+ * the executor's eventfd, which an event loop registers with epoll.
+ */
+
+#ifndef P_SORT_ASYNC_H
+#define P_SORT_ASYNC_H
+
+#include "p_merge_sort.h"
+
+typedef enum {
+    ASYNC_SORT_PENDING,
+    ASYNC_SORT_DONE,
+    ASYNC_SORT_CANCELLED // Cancelled or past its deadline before the sort completed, the output is incomplete
+} AsyncSortState;
+
+typedef struct SortFuture SortFuture;
+typedef struct SortExecutor SortExecutor;
+
+typedef void (*SortCallback)(SortFuture* future, AsyncSortState state, void* user_data);
+
+struct SortFuture {
+    SortArgs args;
+    Task task;
+    JobContext job;
+    SortExecutor* executor;
+    SortCallback callback;
+    void* user_data;
+    atomic_bool done;
+    bool cancelled;
+    SortFuture* next; // In the pending or the completed list of the executor
+};
+
+struct SortExecutor {
+    ThreadPool* pool;
+    int event_fd;
+    pthread_t dispatcher; // Hands pending sorts to the pool as soon as it accepts them
+    pthread_mutex_t mutex;
+    pthread_cond_t cond; // Wakes the dispatcher
+    PoolListener listener; // Signals cond whenever the pool frees a slot
+    pthread_cond_t done_cond; // Signals completed sorts
+    SortFuture* pending; // Sorts the pool has not accepted yet, by priority
+    SortFuture* completed; // Completed sorts without a callback, not taken yet
+    SortFuture* completed_tail;
+    int in_flight; // Sorts submitted and not completed
+    bool stopping;
+};
+
+/**
+ * Create an executor that runs sorts on a thread pool
+ * @param pool The thread pool, which must outlive the executor
+ * @return The executor, or NULL if its eventfd or dispatcher could not be created
+ */
+SortExecutor* createSortExecutor(ThreadPool* pool);
+
+/**
+ * Wait for every submitted sort and its callback to complete, then destroy the
+ * executor. Free the remaining futures first, they cannot be used afterwards
+ * @param executor The executor
+ */
+void destroySortExecutor(SortExecutor* executor);
+
+/**
+ * Get the eventfd of the executor. It becomes readable whenever a sort
+ * without a callback completes. Read it to reset it, then call
+ * takeCompletedSort() until it returns NULL
+ * @param executor The executor
+ * @return A non-blocking eventfd
+ */
+int sortExecutorEventFd(SortExecutor* executor);
+
+/**
+ * Start sorting A into B without blocking
+ * @param executor The executor
+ * @param A The array to sort, left untouched
+ * @param n The number of elements
+ * @param B The output array of n elements
+ * @param priority The task priority of the sort, 0 being the highest
+ * @param timeout The deadline of the sort in seconds, 0 for none
+ * @param callback Called on a worker thread when the sort completes, with its final state. The future only
+ * becomes done once the callback returns, so the callback must not free it. If NULL, the completion goes
+ * through the eventfd and takeCompletedSort() instead
+ * @param user_data Passed to the callback
+ * @return The future of the sort, or NULL without queueing anything if executor is NULL, n is negative,
+ * or A or B is NULL while n is positive
+ */
+SortFuture* submitSort(SortExecutor* executor, const int* A, int n, int* B, int priority, double timeout,
+                       SortCallback callback, void* user_data);
+
+/**
+ * Take the oldest completed sort that has no callback
+ * @param executor The executor
+ * @return The future, or NULL if none is waiting
+ */
+SortFuture* takeCompletedSort(SortExecutor* executor);
+
+/**
+ * Check a sort without blocking. A sort with a callback stays pending until the callback returns
+ * @param future The future
+ * @return The state of the sort
+ */
+AsyncSortState getSortState(SortFuture* future);
+
+/**
+ * Block until a sort completes, including its callback
+ * @param future The future
+ * @return The final state of the sort
+ */
+AsyncSortState waitForSort(SortFuture* future);
+
+/**
+ * Ask a sort to stop. It still completes, as ASYNC_SORT_CANCELLED unless it had already finished
+ * @param future The future
+ */
+void cancelSort(SortFuture* future);
+
+/**
+ * Free a future. A sort that has not completed yet is cancelled and waited for first
+ * @param future The future
+ */
+void freeSortFuture(SortFuture* future);
+
+#endif //P_SORT_ASYNC_H
@@ -0,0 +1,271 @@
+/*
+ * Created by Nikos Ntokos on 24/4/24.
+ * Copyright (c) 2024, Nikos Ntokos
+ * All rights reserved.
+ */
+
+#include "p_string_sort.h"
+#include "p_merge_sort.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define STRING_KEY_MIN_CHUNK 4096 // Fewest strings worth building keys for in a task of their own
+
+static uint64_t load_big_endian(const char* bytes) {
+    uint64_t word;
+    memcpy(&word, bytes, sizeof(word));
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+    word = __builtin_bswap64(word);
+#endif
+    return word;
+}
+
+// Index of the first differing byte of two different big-endian words
+static size_t first_difference(uint64_t a, uint64_t b) {
+    return (size_t)__builtin_clzll(a ^ b) / 8;
+}
+
+StringKey string_key(const char* ptr, size_t len) {
+    StringKey key = {0, ptr, len};
+    if (len >= STRING_PREFIX_BYTES) {
+        key.prefix = load_big_endian(ptr);
+    } else {
+        for (size_t i = 0; i < len; i++) {
+            key.prefix |= (uint64_t)(unsigned char)ptr[i] << (8 * (STRING_PREFIX_BYTES - 1 - i));
+        }
+    }
+    return key;
+}
+
+int string_key_compare(const StringKey* a, const StringKey* b, size_t skip, size_t* lcp) {
+    size_t m = a->len < b->len ? a->len : b->len;
+    if (a->prefix != b->prefix) {
+        // Decided by the cached prefixes. The padding can make them agree past the end of the shorter key
+        size_t common = first_difference(a->prefix, b->prefix);
+        *lcp = common < m ? common : m;
+        return a->prefix < b->prefix ? -1 : 1;
+    }
+
+    // Equal prefixes cover the first min(m, STRING_PREFIX_BYTES) bytes
+    size_t i = m < STRING_PREFIX_BYTES ? m : STRING_PREFIX_BYTES;
+    if (skip > i) {
+        i = skip;
+    }
+    while (i + sizeof(uint64_t) <= m) {
+        uint64_t x = load_big_endian(a->ptr + i);
+        uint64_t y = load_big_endian(b->ptr + i);
+        if (x != y) {
+            *lcp = i + first_difference(x, y);
+            return x < y ? -1 : 1;
+        }
+        i += sizeof(uint64_t);
+    }
+    while (i < m && a->ptr[i] == b->ptr[i]) {
+        i++;
+    }
+    *lcp = i;
+    if (i < m) {
+        return (unsigned char)a->ptr[i] < (unsigned char)b->ptr[i] ? -1 : 1;
+    }
+    return (a->len > b->len) - (a->len < b->len);
+}
+
+// Binary search over keys stride bytes apart, see string_key_binary_search
+static int strided_binary_search(const StringKey* x, const char* arr, size_t stride, int p, int r) {
+    // low is the starting index p, and high is the max of p and r+1
+    int low = p;
+    int high = (p > r + 1) ? p : r + 1;
+    // Common prefixes of x with arr[low - 1] and arr[high]. Every key between them shares
+    // the shorter one with x, so the comparison can start past it
+    size_t lcp_low = 0;
+    size_t lcp_high = 0;
+    while (low < high) {
+        int mid = (low + high) / 2;
+        size_t lcp;
+        const StringKey* key = (const StringKey*)(arr + (size_t)mid * stride);
+        if (string_key_compare(x, key, lcp_low < lcp_high ? lcp_low : lcp_high, &lcp) <= 0) {
+            high = mid;
+            lcp_high = lcp;
+        } else {
+            low = mid + 1;
+            lcp_low = lcp;
+        }
+    }
+    return high;
+}
+
+int string_key_binary_search(const StringKey* x, const StringKey* arr, int p, int r) {
+    return strided_binary_search(x, (const char*)arr, sizeof(StringKey), p, r);
+}
+
+static int string_entry_search(const void* x, const void* arr, int p, int r) {
+    return strided_binary_search(&((const StringEntry*)x)->key, (const char*)arr, sizeof(StringEntry), p, r);
+}
+
+static size_t common_prefix(const StringKey* a, const StringKey* b) {
+    size_t lcp;
+    string_key_compare(a, b, 0, &lcp);
+    return lcp;
+}
+
+/*
+ * LCP merge of two sorted runs. h1 and h2 are the common prefixes of the run heads
+ * with the last key output. Both heads sort after that key, so the head sharing
+ * more of it is the smaller one, and only equal values need a comparison, which
+ * can start past them. The common prefixes within each run come from the entries.
+ */
+static void string_entry_merge(const void* from, int p1, int r1, int p2, int r2, void* to, int p3) {
+    const StringEntry* T = (const StringEntry*)from;
+    StringEntry* A = (StringEntry*)to;
+    size_t h1 = 0;
+    size_t h2 = 0;
+    while (p1 <= r1 && p2 <= r2) {
+        bool take_first;
+        if (h1 != h2) {
+            take_first = h1 > h2;
+        } else {
+            size_t lcp;
+            take_first = string_key_compare(&T[p2].key, &T[p1].key, h1, &lcp) >= 0;
+            // The head left behind now shares lcp with the key about to be output
+            if (take_first) {
+                h2 = lcp;
+            } else {
+                h1 = lcp;
+            }
+        }
+        if (take_first) {
+            A[p3].key = T[p1].key;
+            A[p3++].lcp = h1;
+            p1++;
+            h1 = p1 <= r1 ? T[p1].lcp : 0;
+        } else {
+            A[p3].key = T[p2].key;
+            A[p3++].lcp = h2;
+            p2++;
+            h2 = p2 <= r2 ? T[p2].lcp : 0;
+        }
+    }
+    for (size_t h = h1; p1 <= r1; p1++, p3++) {
+        A[p3].key = T[p1].key;
+        A[p3].lcp = h;
+        h = p1 + 1 <= r1 ? T[p1 + 1].lcp : 0;
+    }
+    for (size_t h = h2; p2 <= r2; p2++, p3++) {
+        A[p3].key = T[p2].key;
+        A[p3].lcp = h;
+        h = p2 + 1 <= r2 ? T[p2 + 1].lcp : 0;
+    }
+}
+
+// The halves of a split merge did not know the key before their first output, so the common prefixes around q3 are set here
+static void string_entry_join(void* to, int p3, int q3, int r3) {
+    StringEntry* A = (StringEntry*)to;
+    A[q3].lcp = q3 > p3 ? common_prefix(&A[q3 - 1].key, &A[q3].key) : 0;
+    if (q3 < r3) {
+        A[q3 + 1].lcp = common_prefix(&A[q3].key, &A[q3 + 1].key);
+    }
+}
+
+// A single entry is a run of its own, so every input entry starts with a zero common prefix
+const SortKind string_entry_sort_kind = {sizeof(StringEntry), string_entry_search, string_entry_merge, string_entry_join};
+
+// Building the keys loads the first bytes of every string, a cache miss each, so it is split among the pool
+static void* build_string_entries(void* args) {
+    StringKeyArgs* keyArgs = (StringKeyArgs*) args;
+    for (int i = keyArgs->start; i < keyArgs->end; i++) {
+        if (keyArgs->strings != NULL) {
+            const char* string = keyArgs->strings[i];
+            size_t len = keyArgs->lengths != NULL ? keyArgs->lengths[i] : strlen(string);
+            keyArgs->entries[i].key = string_key(string, len);
+        } else {
+            keyArgs->entries[i].key = keyArgs->keys[i];
+        }
+        keyArgs->entries[i].lcp = 0;
+    }
+    return NULL;
+}
+
+static void* copy_string_keys(void* args) {
+    StringKeyArgs* keyArgs = (StringKeyArgs*) args;
+    for (int i = keyArgs->start; i < keyArgs->end; i++) {
+        keyArgs->keys[i] = keyArgs->entries[i].key;
+    }
+    return NULL;
+}
+
+static int no_chunks(ThreadPool* pool, int n) {
+    if (pool == NULL) {
+        return 1;
+    }
+    int chunks = pool->max_threads + 1; // The calling thread takes the chunks the queue rejects
+    int max_chunks = n / STRING_KEY_MIN_CHUNK;
+    if (chunks > max_chunks) {
+        chunks = max_chunks;
+    }
+    return chunks < 1 ? 1 : chunks;
+}
+
+// Run function over chunks of the n keys, args is copied into every chunk with its own range
+static void run_key_chunks(ThreadPool* pool, void* (*function)(void*), StringKeyArgs args, int n) {
+    int chunks = no_chunks(pool, n);
+    StringKeyArgs* key_args = (StringKeyArgs*)malloc(chunks * sizeof(StringKeyArgs));
+    Task* tasks = (Task*)calloc(chunks, sizeof(Task));
+    if (!key_args || !tasks) {
+        fprintf(stderr, "Failed to allocate memory\n");
+        exit(EXIT_FAILURE);
+    }
+    for (int c = 0; c < chunks; c++) {
+        key_args[c] = args;
+        key_args[c].start = (int)((long)n * c / chunks);
+        key_args[c].end = (int)((long)n * (c + 1) / chunks);
+        tasks[c].function = function;
+        tasks[c].args = &key_args[c];
+    }
+    runTasks(pool, tasks, chunks);
+    free(tasks);
+    free(key_args);
+}
+
+// Sort the keys of strings, or keys when strings is NULL, into sorted
+static void sort_keys(ThreadPool* pool, const char* const* strings, const size_t* lengths, StringKey* keys, int n,
+                      StringKey* sorted) {
+    StringEntry* entries = (StringEntry*)malloc(2 * (size_t)n * sizeof(StringEntry)); // The input, then the sorted entries
+    StringEntry* scratch = (StringEntry*)malloc(2 * (size_t)n * sizeof(StringEntry));
+    if (!entries || !scratch) {
+        fprintf(stderr, "Failed to allocate memory\n");
+        exit(EXIT_FAILURE);
+    }
+    StringKeyArgs args = {strings, lengths, keys, entries, 0, n};
+    run_key_chunks(pool, build_string_entries, args, n);
+
+    KindSortArgs sort_args = {&string_entry_sort_kind, entries, 0, n - 1, entries + n, 0, pool, 0, NULL, scratch, scratch + n};
+    p_merge_sort_kind(&sort_args);
+
+    args = (StringKeyArgs){NULL, NULL, sorted, entries + n, 0, n};
+    run_key_chunks(pool, copy_string_keys, args, n);
+    free(scratch);
+    free(entries);
+}
+
+int p_sort_strings(ThreadPool* pool, const char* const* strings, const size_t* lengths, int n, StringKey* sorted) {
+    if (strings == NULL || sorted == NULL || n < 0) {
+        return -1;
+    }
+    if (n == 0) {
+        return 0;
+    }
+    sort_keys(pool, strings, lengths, NULL, n, sorted);
+    return 0;
+}
+
+int p_sort_string_keys(ThreadPool* pool, StringKey* keys, int n) {
+    if (keys == NULL || n < 0) {
+        return -1;
+    }
+    if (n <= 1) {
+        return 0;
+    }
+    sort_keys(pool, NULL, NULL, keys, n, keys); // The keys are copied into the entries before the output is written
+    return 0;
+}
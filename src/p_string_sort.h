@@ -0,0 +1,90 @@
+/*
+ * Created by Nikos Ntokos on 24/4/24.
+ * Copyright (c) 2024, Nikos Ntokos
+ * All rights reserved.
+ */
+
+#ifndef P_STRING_SORT_H
+#define P_STRING_SORT_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "multithreading.h"
+#include "p_merge_sort.h"
+
+#define STRING_PREFIX_BYTES 8 // Bytes of every key cached in StringKey.prefix
+
+/*
+ * A variable-length byte key. The first STRING_PREFIX_BYTES bytes are cached
+ * inline, big-endian and zero padded, so that comparing two prefixes as
+ * integers orders them like memcmp and most comparisons never follow ptr.
+ * Keys are ordered bytewise as unsigned chars, a key sorting before the keys
+ * it is a proper prefix of.
+ */
+typedef struct {
+    uint64_t prefix;
+    const char* ptr;
+    size_t len;
+} StringKey;
+
+/*
+ * Element the string sort moves through the shared merge sort recursion: a key
+ * and the length of its common prefix with the key before it in its run.
+ */
+typedef struct {
+    StringKey key;
+    size_t lcp;
+} StringEntry;
+
+typedef struct {
+    const char* const* strings; // NULL to take the keys from keys instead
+    const size_t* lengths; // NULL for NUL-terminated strings
+    StringKey* keys;
+    StringEntry* entries;
+    int start;
+    int end;
+} StringKeyArgs;
+
+extern const SortKind string_entry_sort_kind;
+
+/**
+ * Build the key of a byte string
+ * @param ptr The bytes, which must outlive the key
+ * @param len The number of bytes
+ * @return The key, with its prefix cached
+ */
+StringKey string_key(const char* ptr, size_t len);
+
+/**
+ * Compare two keys whose first skip bytes are known to be equal
+ * @param a The first key
+ * @param b The second key
+ * @param skip Length of a prefix the keys are known to share, 0 if unknown
+ * @param lcp Where the length of the longest common prefix of the keys is stored
+ * @return Negative, zero or positive like memcmp
+ */
+int string_key_compare(const StringKey* a, const StringKey* b, size_t skip, size_t* lcp);
+
+int string_key_binary_search(const StringKey* x, const StringKey* arr, int p, int r);
+
+/**
+ * Sort byte strings
+ * @param pool The thread pool to use, or NULL to run on the calling thread
+ * @param strings The strings, which must outlive the output keys
+ * @param lengths The length of every string, or NULL for NUL-terminated strings
+ * @param n The number of strings
+ * @param sorted The output, n keys in ascending order
+ * @return 0 on success, -1 on invalid arguments
+ */
+int p_sort_strings(ThreadPool* pool, const char* const* strings, const size_t* lengths, int n, StringKey* sorted);
+
+/**
+ * Sort keys built with string_key() in place
+ * @param pool The thread pool to use, or NULL to run on the calling thread
+ * @param keys The keys
+ * @param n The number of keys
+ * @return 0 on success, -1 on invalid arguments
+ */
+int p_sort_string_keys(ThreadPool* pool, StringKey* keys, int n);
+
+#endif //P_STRING_SORT_H
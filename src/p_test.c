@@ -0,0 +1,733 @@
+/*
+ * Created by Nikos Ntokos on 24/4/24.
+ * Copyright (c) 2024, Nikos Ntokos
+ * All rights reserved.
+ */
+
+/*
+ * Correctness tests for the sorting engines. Every engine is run on the
+ * calling thread and on a pool, and its output is compared with qsort or a
+ * naive reference. The exit code is 1 if any check failed.
+ */
+
+#include "p_merge_sort.h"
+#include "p_select.h"
+#include "p_merge_arrays.h"
+#include "p_argsort.h"
+#include "p_low_cardinality.h"
+#include "p_sort_async.h"
+#include "p_string_sort.h"
+#include <limits.h>
+#include <poll.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "verbosity.h"
+
+#define TEST_THREADS 3
+#define TEST_TASKS_IN_QUEUE 3
+#define TEST_SEED 42
+
+#define LARGE_SIZE 200003
+#define STRING_COUNT 20000
+#define STRING_MAX_LENGTH 20
+
+static int no_checks = 0;
+static int no_failures = 0;
+
+static void check(bool ok, const char* name, const char* mode) {
+    no_checks++;
+    if (!ok) {
+        no_failures++;
+        fprintf(stderr, "FAIL: %s (%s)\n", name, mode);
+    }
+}
+
+static void* checked_malloc(size_t size) {
+    void* ptr = malloc(size > 0 ? size : 1);
+    if (ptr == NULL) {
+        fprintf(stderr, "Failed to allocate memory\n");
+        exit(EXIT_FAILURE);
+    }
+    return ptr;
+}
+
+static int compare_ints(const void* a, const void* b) {
+    int x = *(const int*)a, y = *(const int*)b;
+    return (x > y) - (x < y);
+}
+
+static int* random_array(int n, int max, unsigned int* seed) {
+    int* A = (int*)checked_malloc(n * sizeof(int));
+    for (int i = 0; i < n; i++) {
+        A[i] = rand_r(seed) % max;
+    }
+    return A;
+}
+
+static int* sorted_copy(const int* A, int n) {
+    int* S = (int*)checked_malloc(n * sizeof(int));
+    memcpy(S, A, n * sizeof(int));
+    qsort(S, n, sizeof(int), compare_ints);
+    return S;
+}
+
+static void test_merge_sort(ThreadPool* pool, const char* mode) {
+    unsigned int seed = TEST_SEED;
+    const int sizes[] = {1, 2, 3, 17, 1000, 4099, LARGE_SIZE};
+    for (int t = 0; t < (int)(sizeof(sizes) / sizeof(sizes[0])); t++) {
+        int n = sizes[t];
+        int* A = random_array(n, 1000, &seed);
+        int* expected = sorted_copy(A, n);
+        int* B = (int*)checked_malloc(n * sizeof(int));
+        int* scratch = (int*)checked_malloc(2 * (size_t)n * sizeof(int));
+
+        SortArgs args = {A, 0, n - 1, B, 0, pool, 0, NULL, NULL, NULL};
+        p_merge_sort(&args);
+        check(memcmp(B, expected, n * sizeof(int)) == 0, "p_merge_sort", mode);
+
+        memset(B, 0, n * sizeof(int));
+        SortArgs scratch_args = {A, 0, n - 1, B, 0, pool, 0, NULL, scratch, scratch + n};
+        p_merge_sort(&scratch_args);
+        check(memcmp(B, expected, n * sizeof(int)) == 0, "p_merge_sort with a scratch arena", mode);
+
+        free(scratch);
+        free(B);
+        free(expected);
+        free(A);
+    }
+}
+
+static void test_select(ThreadPool* pool, const char* mode) {
+    unsigned int seed = TEST_SEED;
+    int n = LARGE_SIZE;
+    int* A = random_array(n, n / 4, &seed); // Plenty of duplicates around every rank
+    int* expected = sorted_copy(A, n);
+
+    const int ranks[] = {0, 1, n / 3, n / 2, n - 2, n - 1};
+    for (int i = 0; i < (int)(sizeof(ranks) / sizeof(ranks[0])); i++) {
+        int k = ranks[i];
+        int value = -1;
+        check(p_select(pool, A, n, k, &value) == 0 && value == expected[k], "p_select", mode);
+
+        int* C = (int*)checked_malloc(n * sizeof(int));
+        memcpy(C, A, n * sizeof(int));
+        bool ok = p_nth_element(pool, C, n, k) == 0 && C[k] == expected[k];
+        for (int j = 0; ok && j < n; j++) {
+            ok = j < k ? C[j] <= C[k] : C[j] >= C[k];
+        }
+        qsort(C, n, sizeof(int), compare_ints); // Still a permutation of A
+        check(ok && memcmp(C, expected, n * sizeof(int)) == 0, "p_nth_element", mode);
+        free(C);
+    }
+
+    const int top[] = {0, 1, 100, n};
+    int* out = (int*)checked_malloc(n * sizeof(int));
+    for (int i = 0; i < (int)(sizeof(top) / sizeof(top[0])); i++) {
+        int k = top[i];
+        check(p_top_k(pool, A, n, k, out) == 0 && memcmp(out, expected, k * sizeof(int)) == 0, "p_top_k", mode);
+    }
+
+    const double q[] = {0.0, 0.25, 0.5, 0.9, 0.999, 1.0};
+    int m = (int)(sizeof(q) / sizeof(q[0]));
+    bool ok = p_quantiles(pool, A, n, q, m, out) == 0;
+    for (int i = 0; ok && i < m; i++) {
+        ok = out[i] == expected[(int)(q[i] * (n - 1))];
+    }
+    check(ok, "p_quantiles", mode);
+    check(p_select(pool, A, n, n, out) == -1, "p_select rejects a rank out of range", mode);
+
+    free(out);
+    free(expected);
+    free(A);
+}
+
+static void test_merge_arrays(ThreadPool* pool, const char* mode) {
+    unsigned int seed = TEST_SEED;
+    const int sizes[] = {0, 1, 5000, 0, 77, LARGE_SIZE / 2, 3};
+    int k = (int)(sizeof(sizes) / sizeof(sizes[0]));
+    int total = 0;
+    int* arrays[sizeof(sizes) / sizeof(sizes[0])];
+    for (int i = 0; i < k; i++) {
+        arrays[i] = random_array(sizes[i], 5000, &seed);
+        qsort(arrays[i], sizes[i], sizeof(int), compare_ints);
+        total += sizes[i];
+    }
+    int* all = (int*)checked_malloc(total * sizeof(int));
+    int* out = (int*)checked_malloc(total * sizeof(int));
+
+    int n = sizes[2] + sizes[5];
+    memcpy(all, arrays[2], sizes[2] * sizeof(int));
+    memcpy(all + sizes[2], arrays[5], sizes[5] * sizeof(int));
+    qsort(all, n, sizeof(int), compare_ints);
+    check(p_merge_arrays(pool, arrays[2], sizes[2], arrays[5], sizes[5], out) == 0
+          && memcmp(out, all, n * sizeof(int)) == 0, "p_merge_arrays", mode);
+
+    for (int i = 0, offset = 0; i < k; offset += sizes[i], i++) {
+        memcpy(all + offset, arrays[i], sizes[i] * sizeof(int));
+    }
+    qsort(all, total, sizeof(int), compare_ints);
+    check(p_merge_k_arrays(pool, (const int* const*)arrays, sizes, k, out) == 0
+          && memcmp(out, all, total * sizeof(int)) == 0, "p_merge_k_arrays", mode);
+
+    // The batch is unsorted, only A is
+    int* batch = random_array(sizes[2], 5000, &seed);
+    memcpy(all, arrays[5], sizes[5] * sizeof(int));
+    memcpy(all + sizes[5], batch, sizes[2] * sizeof(int));
+    qsort(all, n, sizeof(int), compare_ints);
+    check(p_insert_batch(pool, arrays[5], sizes[5], batch, sizes[2], out) == 0
+          && memcmp(out, all, n * sizeof(int)) == 0, "p_insert_batch", mode);
+
+    // Sizes adding up past INT_MAX are rejected before any input is read
+    const int huge_sizes[] = {INT_MAX / 2 + 1, INT_MAX / 2 + 1};
+    const int* const huge_arrays[] = {arrays[0], arrays[0]};
+    check(p_merge_k_arrays(pool, huge_arrays, huge_sizes, 2, out) == -1, "p_merge_k_arrays rejects an int overflow", mode);
+    check(p_merge_arrays(pool, arrays[0], INT_MAX, arrays[0], 1, out) == -1, "p_merge_arrays rejects an int overflow", mode);
+
+    free(batch);
+    free(out);
+    free(all);
+    for (int i = 0; i < k; i++) {
+        free(arrays[i]);
+    }
+}
+
+// Reference order of the argsort tests: the key columns, then the row, which makes a sort stable
+static const int* const* reference_columns;
+static int reference_no_columns;
+
+static int compare_rows(const void* a, const void* b) {
+    int x = *(const int*)a, y = *(const int*)b;
+    for (int c = 0; c < reference_no_columns; c++) {
+        int cmp = compare_ints(&reference_columns[c][x], &reference_columns[c][y]);
+        if (cmp != 0) {
+            return cmp;
+        }
+    }
+    return (x > y) - (x < y);
+}
+
+static bool argsort_matches(const int* const* columns, int no_columns, int n, const int* perm) {
+    int* expected = (int*)checked_malloc(n * sizeof(int));
+    for (int i = 0; i < n; i++) {
+        expected[i] = i;
+    }
+    reference_columns = columns;
+    reference_no_columns = no_columns;
+    qsort(expected, n, sizeof(int), compare_rows);
+    bool ok = memcmp(expected, perm, n * sizeof(int)) == 0;
+    free(expected);
+    return ok;
+}
+
+static void test_argsort(ThreadPool* pool, const char* mode) {
+    unsigned int seed = TEST_SEED;
+    int n = LARGE_SIZE / 2;
+    int* perm = (int*)checked_malloc(n * sizeof(int));
+
+    // Few distinct keys, so most of the order comes from stability
+    int* keys = random_array(n, 100, &seed);
+    for (int i = 0; i < n; i += 7) {
+        keys[i] = -keys[i];
+    }
+    const int* key_column[] = {keys};
+    check(p_argsort(pool, keys, n, perm) == 0 && argsort_matches(key_column, 1, n, perm), "p_argsort", mode);
+
+    // Narrow columns, packed into a single key
+    int* narrow[3];
+    for (int c = 0; c < 3; c++) {
+        narrow[c] = random_array(n, 1 << (4 * c + 1), &seed);
+    }
+    check(p_argsort_columns(pool, (const int* const*)narrow, 3, n, perm) == 0
+          && argsort_matches((const int* const*)narrow, 3, n, perm), "p_argsort_columns packed", mode);
+
+    // Columns spanning the whole int range need 32 bits each, so three of them take two stable passes
+    int* wide[3];
+    for (int c = 0; c < 3; c++) {
+        wide[c] = random_array(n, 4, &seed);
+        for (int i = 0; i < n; i++) {
+            wide[c][i] = wide[c][i] == 0 ? INT32_MIN : wide[c][i] == 3 ? INT32_MAX : wide[c][i] - 2;
+        }
+    }
+    check(p_argsort_columns(pool, (const int* const*)wide, 3, n, perm) == 0
+          && argsort_matches((const int* const*)wide, 3, n, perm), "p_argsort_columns over several passes", mode);
+
+    // A constant column leaves the order to the others
+    int* mixed[] = {narrow[0], wide[2], narrow[2]};
+    for (int i = 0; i < n; i++) {
+        narrow[2][i] = 7;
+    }
+    check(p_argsort_columns(pool, (const int* const*)mixed, 3, n, perm) == 0
+          && argsort_matches((const int* const*)mixed, 3, n, perm), "p_argsort_columns with a constant column", mode);
+
+    for (int c = 0; c < 3; c++) {
+        free(narrow[c]);
+        free(wide[c]);
+    }
+    free(keys);
+    free(perm);
+}
+
+static void check_low_cardinality(ThreadPool* pool, const int* A, int n, const char* name, const char* mode) {
+    int* expected = sorted_copy(A, n);
+    int* B = (int*)checked_malloc(n * sizeof(int));
+    check(p_sort_low_cardinality(pool, A, n, B) == 0 && memcmp(B, expected, n * sizeof(int)) == 0, name, mode);
+    free(B);
+    free(expected);
+}
+
+static void test_low_cardinality(ThreadPool* pool, const char* mode) {
+    unsigned int seed = TEST_SEED;
+    int n = LARGE_SIZE;
+    int* A = random_array(n, 50, &seed);
+    for (int i = 0; i < n; i += 3) {
+        A[i] = -A[i];
+    }
+    check_low_cardinality(pool, A, n, "p_sort_low_cardinality dense keys", mode);
+
+    // A range much wider than n takes the hash tables
+    for (int i = 0; i < n; i++) {
+        A[i] = (rand_r(&seed) % 1000 - 500) * 1000003;
+    }
+    check_low_cardinality(pool, A, n, "p_sort_low_cardinality hashed keys", mode);
+
+    // Half of the keys are equal, but the distinct others show up once each in the sample, so it rules out the hash tables
+    for (int i = 0; i < n; i++) {
+        A[i] = i % 2 == 0 ? 0 : (int)((long)i * 7919 % 2000000011) - 1000000000;
+    }
+    check_low_cardinality(pool, A, n, "p_sort_low_cardinality rejected by the sample", mode);
+
+    // Only the sampled positions repeat a few keys, so the hash tables overflow and the sort falls back
+    for (int i = 0; i < 1024; i++) {
+        A[(long)i * n / 1024] = (i % 256) * 1000003;
+    }
+    check_low_cardinality(pool, A, n, "p_sort_low_cardinality hash overflow", mode);
+
+    // Distinct keys, sorted without a fast path
+    for (int i = 0; i < n; i++) {
+        A[i] = rand_r(&seed);
+    }
+    check_low_cardinality(pool, A, n, "p_sort_low_cardinality distinct keys", mode);
+    free(A);
+}
+
+static int compare_bytes(const char* a, size_t a_len, const char* b, size_t b_len) {
+    size_t len = a_len < b_len ? a_len : b_len;
+    int cmp = memcmp(a, b, len);
+    if (cmp != 0) {
+        return cmp;
+    }
+    return (a_len > b_len) - (a_len < b_len);
+}
+
+static size_t common_prefix(const char* a, size_t a_len, const char* b, size_t b_len) {
+    size_t i = 0;
+    while (i < a_len && i < b_len && a[i] == b[i]) {
+        i++;
+    }
+    return i;
+}
+
+static int compare_pointers(const void* a, const void* b) {
+    const char* x = *(const char* const*)a;
+    const char* y = *(const char* const*)b;
+    return (x > y) - (x < y);
+}
+
+static int sign(int x) {
+    return (x > 0) - (x < 0);
+}
+
+static void test_string_key_compare() {
+    // Padding bytes of the prefix are zero, so keys ending in NUL bytes must still be told apart by length
+    const struct {
+        const char* a;
+        size_t a_len;
+        const char* b;
+        size_t b_len;
+    } cases[] = {
+        {"", 0, "", 0},
+        {"", 0, "\0", 1},
+        {"a", 1, "a\0", 2},
+        {"a\0\0\0\0\0\0", 7, "a\0\0\0\0\0\0\0", 8},
+        {"abcdefgh", 8, "abcdefgh\0", 9},
+        {"abcdefgh", 8, "abcdefghi", 9},
+        {"abcdefghij", 10, "abcdefghxy", 10},
+        {"abcdefghijklmnop", 16, "abcdefghijklmnoq", 16},
+        {"abc", 3, "abd", 3},
+        {"\xff", 1, "\x01", 1},
+        {"same key", 8, "same key", 8},
+    };
+    for (int i = 0; i < (int)(sizeof(cases) / sizeof(cases[0])); i++) {
+        StringKey a = string_key(cases[i].a, cases[i].a_len);
+        StringKey b = string_key(cases[i].b, cases[i].b_len);
+        int expected = sign(compare_bytes(cases[i].a, cases[i].a_len, cases[i].b, cases[i].b_len));
+        size_t expected_lcp = common_prefix(cases[i].a, cases[i].a_len, cases[i].b, cases[i].b_len);
+        for (size_t skip = 0; skip <= expected_lcp; skip += expected_lcp > 0 ? expected_lcp : 1) {
+            size_t lcp = (size_t)-1;
+            check(sign(string_key_compare(&a, &b, skip, &lcp)) == expected && lcp == expected_lcp,
+                  "string_key_compare", "calling thread");
+            check(sign(string_key_compare(&b, &a, skip, &lcp)) == -expected && lcp == expected_lcp,
+                  "string_key_compare reversed", "calling thread");
+        }
+    }
+}
+
+static void test_string_sort(ThreadPool* pool, const char* mode) {
+    unsigned int seed = TEST_SEED;
+    int n = STRING_COUNT;
+    char** strings = (char**)checked_malloc(n * sizeof(char*));
+    size_t* lengths = (size_t*)checked_malloc(n * sizeof(size_t));
+    // A tiny alphabet with NUL bytes gives long common prefixes and keys that differ only in trailing NULs
+    const char alphabet[] = {'\0', 'a', 'b'};
+    for (int i = 0; i < n; i++) {
+        lengths[i] = rand_r(&seed) % (STRING_MAX_LENGTH + 1);
+        strings[i] = (char*)checked_malloc(lengths[i]);
+        for (size_t j = 0; j < lengths[i]; j++) {
+            strings[i][j] = alphabet[rand_r(&seed) % 3];
+        }
+    }
+
+    StringKey* sorted = (StringKey*)checked_malloc(n * sizeof(StringKey));
+    bool ok = p_sort_strings(pool, (const char* const*)strings, lengths, n, sorted) == 0;
+    for (int i = 1; ok && i < n; i++) {
+        ok = compare_bytes(sorted[i - 1].ptr, sorted[i - 1].len, sorted[i].ptr, sorted[i].len) <= 0;
+    }
+    // The output holds every input string once
+    const char** inputs = (const char**)checked_malloc(n * sizeof(char*));
+    const char** outputs = (const char**)checked_malloc(n * sizeof(char*));
+    for (int i = 0; i < n; i++) {
+        inputs[i] = strings[i];
+        outputs[i] = sorted[i].ptr;
+    }
+    qsort(inputs, n, sizeof(char*), compare_pointers);
+    qsort(outputs, n, sizeof(char*), compare_pointers);
+    ok = ok && memcmp(inputs, outputs, n * sizeof(char*)) == 0;
+    check(ok, "p_sort_strings", mode);
+
+    for (int i = 0; i < n; i++) {
+        sorted[i] = string_key(strings[i], lengths[i]);
+    }
+    ok = p_sort_string_keys(pool, sorted, n) == 0;
+    for (int i = 1; ok && i < n; i++) {
+        ok = compare_bytes(sorted[i - 1].ptr, sorted[i - 1].len, sorted[i].ptr, sorted[i].len) <= 0;
+    }
+    check(ok, "p_sort_string_keys", mode);
+
+    free(outputs);
+    free(inputs);
+    free(sorted);
+    for (int i = 0; i < n; i++) {
+        free(strings[i]);
+    }
+    free(lengths);
+    free(strings);
+}
+
+static void test_jobs(ThreadPool* pool, const char* mode) {
+    unsigned int seed = TEST_SEED;
+    int n = LARGE_SIZE;
+    int* A = random_array(n, 1000, &seed);
+    int* expected = sorted_copy(A, n);
+    int* B = (int*)checked_malloc(n * sizeof(int));
+
+    JobContext job;
+    initJobContext(&job, NO_PRIORITIES - 1, 60.0);
+    SortArgs args = {A, 0, n - 1, B, 0, pool, 0, &job};
+    p_merge_sort(&args);
+    check(!isJobStopped(&job) && memcmp(B, expected, n * sizeof(int)) == 0, "p_merge_sort of a low priority job", mode);
+    // Cancelling a completed job does not make it look stopped
+    cancelJob(&job);
+    check(isJobCancelled(&job) && !isJobStopped(&job), "cancelJob after completion", mode);
+
+    initJobContext(&job, 0, 0);
+    cancelJob(&job);
+    p_merge_sort(&args);
+    check(isJobStopped(&job), "p_merge_sort of a cancelled job stops", mode);
+
+    initJobContext(&job, 0, 1e-9);
+    struct timespec pause = {0, 1000000};
+    nanosleep(&pause, NULL);
+    check(isJobCancelled(&job) && !isJobStopped(&job), "isJobCancelled after the deadline only reads the job", mode);
+    p_merge_sort(&args);
+    check(isJobStopped(&job), "p_merge_sort of an expired job stops", mode);
+
+    free(B);
+    free(expected);
+    free(A);
+}
+
+// Tasks of the pool tests hold their worker until the gate opens
+static pthread_mutex_t gate_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t gate_cond = PTHREAD_COND_INITIALIZER;
+static bool gate_open = false;
+
+static void* wait_for_gate(void* args) {
+    pthread_mutex_lock(&gate_mutex);
+    while (!gate_open) {
+        pthread_cond_wait(&gate_cond, &gate_mutex);
+    }
+    pthread_mutex_unlock(&gate_mutex);
+    return args;
+}
+
+static void set_gate(bool open) {
+    pthread_mutex_lock(&gate_mutex);
+    gate_open = open;
+    pthread_cond_broadcast(&gate_cond);
+    pthread_mutex_unlock(&gate_mutex);
+}
+
+static void test_admission(ThreadPool* pool) {
+    const char* mode = "pool";
+    Task tasks[TEST_TASKS_IN_QUEUE + 1];
+    bool queued[TEST_TASKS_IN_QUEUE + 1];
+    int no_tasks = TEST_TASKS_IN_QUEUE + 1;
+
+    // Batch work fills the slots that are not reserved, then is turned away
+    set_gate(false);
+    bool ok = true;
+    for (int i = 0; i < no_tasks - 1; i++) {
+        tasks[i] = (Task){.function = wait_for_gate, .priority = 1};
+        queued[i] = addTaskFront(pool, &tasks[i]) == 0;
+        ok = ok && queued[i] == (i < TEST_TASKS_IN_QUEUE - POOL_RESERVED_TASKS);
+    }
+    check(ok, "addTaskFront keeps the reserved slots from low priorities", mode);
+    // A priority 0 task still gets one of them
+    tasks[no_tasks - 1] = (Task){.function = wait_for_gate, .priority = 0};
+    queued[no_tasks - 1] = addTaskFront(pool, &tasks[no_tasks - 1]) == 0;
+    check(queued[no_tasks - 1], "addTaskFront admits priority 0 into a reserved slot", mode);
+
+    set_gate(true);
+    for (int i = 0; i < no_tasks; i++) {
+        if (queued[i]) {
+            waitForTask(pool, &tasks[i]);
+        }
+    }
+}
+
+typedef struct {
+    atomic_int calls;
+    AsyncSortState state;
+} CallbackRecord;
+
+static void record_callback(SortFuture* future, AsyncSortState state, void* user_data) {
+    (void)future;
+    CallbackRecord* record = (CallbackRecord*)user_data;
+    record->state = state;
+    atomic_fetch_add(&record->calls, 1);
+}
+
+static void test_async(ThreadPool* pool) {
+    const char* mode = "async";
+    SortExecutor* executor = createSortExecutor(pool);
+    if (executor == NULL) {
+        exit(EXIT_FAILURE);
+    }
+    unsigned int seed = TEST_SEED;
+    int n = LARGE_SIZE;
+    int* A = random_array(n, 1000, &seed);
+    int* expected = sorted_copy(A, n);
+    int* B[TEST_THREADS];
+    for (int i = 0; i < TEST_THREADS; i++) {
+        B[i] = (int*)checked_malloc(n * sizeof(int));
+    }
+
+    check(submitSort(executor, A, -1, B[0], 0, 0, NULL, NULL) == NULL
+          && submitSort(executor, NULL, n, B[0], 0, 0, NULL, NULL) == NULL
+          && submitSort(executor, A, n, NULL, 0, 0, NULL, NULL) == NULL
+          && submitSort(NULL, A, n, B[0], 0, 0, NULL, NULL) == NULL, "submitSort rejects invalid arguments", mode);
+
+    // Polling
+    memset(B[0], 0, n * sizeof(int));
+    SortFuture* future = submitSort(executor, A, n, B[0], 0, 0, NULL, NULL);
+    struct timespec pause = {0, 1000000};
+    while (getSortState(future) == ASYNC_SORT_PENDING) {
+        nanosleep(&pause, NULL);
+    }
+    check(getSortState(future) == ASYNC_SORT_DONE && memcmp(B[0], expected, n * sizeof(int)) == 0, "getSortState", mode);
+    check(takeCompletedSort(executor) == future && takeCompletedSort(executor) == NULL, "takeCompletedSort after polling", mode);
+    freeSortFuture(future);
+    uint64_t count;
+    while (read(sortExecutorEventFd(executor), &count, sizeof(count)) == sizeof(count)) {
+        // Reset the eventfd for the test below
+    }
+
+    // Callback, the future becomes done once it has returned
+    CallbackRecord record;
+    atomic_init(&record.calls, 0);
+    memset(B[0], 0, n * sizeof(int));
+    future = submitSort(executor, A, n, B[0], 1, 0, record_callback, &record);
+    check(waitForSort(future) == ASYNC_SORT_DONE && atomic_load(&record.calls) == 1 && record.state == ASYNC_SORT_DONE
+          && memcmp(B[0], expected, n * sizeof(int)) == 0, "a callback reports the completion", mode);
+    check(takeCompletedSort(executor) == NULL, "a sort with a callback skips the completed list", mode);
+    freeSortFuture(future);
+
+    // Eventfd, waited on the way an event loop would
+    int event_fd = sortExecutorEventFd(executor);
+    SortFuture* futures[TEST_THREADS];
+    for (int i = 0; i < TEST_THREADS; i++) {
+        memset(B[i], 0, n * sizeof(int));
+        futures[i] = submitSort(executor, A, n, B[i], i % NO_PRIORITIES, 0, NULL, NULL);
+    }
+    int no_taken = 0;
+    bool ok = true;
+    while (ok && no_taken < TEST_THREADS) {
+        struct pollfd poll_fd = {event_fd, POLLIN, 0};
+        ok = poll(&poll_fd, 1, 10000) == 1 && read(event_fd, &count, sizeof(count)) == sizeof(count);
+        for (SortFuture* taken = takeCompletedSort(executor); ok && taken != NULL; taken = takeCompletedSort(executor)) {
+            int i = 0;
+            while (i < TEST_THREADS && futures[i] != taken) {
+                i++;
+            }
+            ok = i < TEST_THREADS && getSortState(taken) == ASYNC_SORT_DONE && memcmp(B[i], expected, n * sizeof(int)) == 0;
+            no_taken++;
+        }
+    }
+    check(ok && no_taken == TEST_THREADS, "the eventfd signals every completion", mode);
+    for (int i = 0; i < TEST_THREADS; i++) {
+        freeSortFuture(futures[i]);
+    }
+
+    // Cancellation, while a busy pool keeps the sort pending
+    Task tasks[TEST_TASKS_IN_QUEUE];
+    set_gate(false);
+    ok = true;
+    for (int i = 0; i < TEST_TASKS_IN_QUEUE; i++) {
+        tasks[i] = (Task){.function = wait_for_gate};
+        ok = ok && addTaskFront(pool, &tasks[i]) == 0;
+    }
+    future = submitSort(executor, A, n, B[0], 0, 0, NULL, NULL);
+    check(ok && getSortState(future) == ASYNC_SORT_PENDING, "a sort waits for a busy pool", mode);
+    cancelSort(future);
+    set_gate(true);
+    for (int i = 0; i < TEST_TASKS_IN_QUEUE; i++) {
+        waitForTask(pool, &tasks[i]);
+    }
+    check(waitForSort(future) == ASYNC_SORT_CANCELLED, "cancelSort", mode);
+    freeSortFuture(future);
+
+    future = submitSort(executor, A, n, B[0], 0, 1e-9, NULL, NULL);
+    check(waitForSort(future) == ASYNC_SORT_CANCELLED, "a sort past its deadline is cancelled", mode);
+    freeSortFuture(future);
+
+    destroySortExecutor(executor);
+    for (int i = 0; i < TEST_THREADS; i++) {
+        free(B[i]);
+    }
+    free(expected);
+    free(A);
+}
+
+static int no_pool_threads(ThreadPool* pool) {
+    pthread_mutex_lock(&(pool->queue.mutex));
+    int no_threads = pool->no_threads;
+    pthread_mutex_unlock(&(pool->queue.mutex));
+    return no_threads;
+}
+
+// Wait up to a few idle timeouts for the pool to reach no_threads workers
+static bool wait_for_pool_threads(ThreadPool* pool, int no_threads) {
+    struct timespec pause = {0, 10000000};
+    for (int waited_ms = 0; waited_ms < 5 * POOL_IDLE_TIMEOUT_MS; waited_ms += 10) {
+        if (no_pool_threads(pool) == no_threads) {
+            return true;
+        }
+        nanosleep(&pause, NULL);
+    }
+    return no_pool_threads(pool) == no_threads;
+}
+
+// Make the pool look oversubscribed, as if its last measurement window had just found a busy host
+static void mark_oversubscribed(ThreadPool* pool) {
+    pthread_mutex_lock(&(pool->queue.mutex));
+    pool->efficiency = pool->min_efficiency / 2;
+    clock_gettime(CLOCK_MONOTONIC, &pool->efficiency_time);
+    pthread_mutex_unlock(&(pool->queue.mutex));
+}
+
+static void test_elastic_pool() {
+    const char* mode = "elastic pool";
+    ThreadPool* pool = createElasticThreadPool(0, TEST_THREADS, TEST_TASKS_IN_QUEUE);
+    if (pool == NULL) {
+        exit(EXIT_FAILURE);
+    }
+    check(no_pool_threads(pool) == 0, "createElasticThreadPool starts min_threads workers", mode);
+
+    // Every task admitted while the workers are busy starts one more
+    Task tasks[TEST_THREADS];
+    set_gate(false);
+    bool ok = true;
+    for (int i = 0; i < TEST_THREADS; i++) {
+        tasks[i] = (Task){.function = wait_for_gate};
+        ok = ok && addTaskFront(pool, &tasks[i]) == 0 && no_pool_threads(pool) == i + 1;
+    }
+    check(ok, "the pool grows by one worker per busy task", mode);
+    set_gate(true);
+    for (int i = 0; i < TEST_THREADS; i++) {
+        waitForTask(pool, &tasks[i]);
+    }
+
+    // An oversubscribed pool sheds its idle workers right away, but keeps the last one for the next task
+    mark_oversubscribed(pool);
+    pthread_mutex_lock(&(pool->queue.mutex));
+    pthread_cond_broadcast(&(pool->queue.cond)); // Wake the idle workers, so that they see the efficiency
+    pthread_mutex_unlock(&(pool->queue.mutex));
+    check(wait_for_pool_threads(pool, 1), "an oversubscribed pool sheds all but one idle worker", mode);
+    set_gate(false);
+    tasks[0] = (Task){.function = wait_for_gate};
+    tasks[1] = (Task){.function = wait_for_gate};
+    check(addTaskFront(pool, &tasks[0]) == 0 && no_pool_threads(pool) == 1, "the warm worker takes the next task", mode);
+    bool queued = addTaskFront(pool, &tasks[1]) == 0;
+    check(!queued, "an oversubscribed pool does not grow", mode);
+    set_gate(true);
+    waitForTask(pool, &tasks[0]);
+    if (queued) {
+        waitForTask(pool, &tasks[1]);
+    }
+    check(wait_for_pool_threads(pool, 0), "the last worker retires after POOL_IDLE_TIMEOUT_MS", mode);
+
+    unsigned int seed = TEST_SEED;
+    int n = LARGE_SIZE;
+    int* A = random_array(n, 1000, &seed);
+    int* expected = sorted_copy(A, n);
+    int* B = (int*)checked_malloc(n * sizeof(int));
+    SortArgs args = {A, 0, n - 1, B, 0, pool, 0, NULL};
+    p_merge_sort(&args);
+    check(memcmp(B, expected, n * sizeof(int)) == 0 && no_pool_threads(pool) >= 1, "p_merge_sort regrows a pool without workers", mode);
+
+    free(B);
+    free(expected);
+    free(A);
+    destroyThreadPool(pool);
+}
+
+int main() {
+    set_verbosity(SILENT);
+    ThreadPool* pool = createThreadPool(TEST_THREADS, TEST_TASKS_IN_QUEUE);
+    if (pool == NULL) {
+        exit(EXIT_FAILURE);
+    }
+
+    test_string_key_compare();
+    for (int run = 0; run < 2; run++) {
+        ThreadPool* run_pool = run == 0 ? NULL : pool;
+        const char* mode = run == 0 ? "calling thread" : "pool";
+        test_merge_sort(run_pool, mode);
+        test_select(run_pool, mode);
+        test_merge_arrays(run_pool, mode);
+        test_argsort(run_pool, mode);
+        test_low_cardinality(run_pool, mode);
+        test_string_sort(run_pool, mode);
+        test_jobs(run_pool, mode);
+    }
+    test_admission(pool);
+    test_async(pool);
+    test_elastic_pool();
+
+    destroyThreadPool(pool);
+    printf("%d of %d checks passed\n", no_checks - no_failures, no_checks);
+    return no_failures == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
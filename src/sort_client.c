@@ -0,0 +1,151 @@
+/*
+ * Created by Nikos Ntokos on 24/4/24.
+ * Copyright (c) 2024, Nikos Ntokos
+ * All rights reserved.
+ */
+
+#define _GNU_SOURCE
+#include "sort_client.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+SortClient* sortClientConnect(const char* socket_path) {
+    if (socket_path == NULL) {
+        socket_path = SORT_SERVICE_DEFAULT_SOCKET;
+    }
+    struct sockaddr_un address;
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    if (strlen(socket_path) >= sizeof(address.sun_path)) {
+        return NULL;
+    }
+    strcpy(address.sun_path, socket_path);
+
+    int fd = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0);
+    if (fd < 0) {
+        return NULL;
+    }
+    if (connect(fd, (struct sockaddr*)&address, sizeof(address)) != 0) {
+        close(fd);
+        return NULL;
+    }
+
+    SortClient* client = (SortClient*)malloc(sizeof(SortClient));
+    if (client == NULL) {
+        fprintf(stderr, "Failed to allocate memory\n");
+        exit(EXIT_FAILURE);
+    }
+    client->socket_fd = fd;
+    client->memfd = -1;
+    client->keys = NULL;
+    client->sorted = NULL;
+    client->capacity = 0;
+    client->buffer_sent = false;
+    return client;
+}
+
+static void release_buffer(SortClient* client) {
+    if (client->memfd < 0) {
+        return;
+    }
+    munmap(client->keys, 2 * (size_t)client->capacity * sizeof(int));
+    close(client->memfd);
+    client->memfd = -1;
+    client->keys = NULL;
+    client->sorted = NULL;
+    client->capacity = 0;
+}
+
+int* sortClientKeys(SortClient* client, int n) {
+    if (n <= client->capacity) {
+        return client->keys;
+    }
+    if (n > SORT_SERVICE_MAX_CAPACITY) {
+        return NULL;
+    }
+    // Grow geometrically so that a slowly growing n does not resend the buffer every time
+    int capacity = client->capacity > SORT_SERVICE_MAX_CAPACITY / 2 ? SORT_SERVICE_MAX_CAPACITY : 2 * client->capacity;
+    if (capacity < n) {
+        capacity = n;
+    }
+    size_t size = 2 * (size_t)capacity * sizeof(int);
+
+    int fd = memfd_create("p_sort_buffer", MFD_CLOEXEC | MFD_ALLOW_SEALING);
+    if (fd < 0) {
+        return NULL;
+    }
+    // The server refuses buffers that could shrink under its mapping
+    if (ftruncate(fd, (off_t)size) != 0 || fcntl(fd, F_ADD_SEALS, F_SEAL_SHRINK | F_SEAL_SEAL) != 0) {
+        close(fd);
+        return NULL;
+    }
+    void* buffer = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (buffer == MAP_FAILED) {
+        close(fd);
+        return NULL;
+    }
+
+    release_buffer(client);
+    client->memfd = fd;
+    client->keys = (int*)buffer;
+    client->sorted = client->keys + capacity;
+    client->capacity = capacity;
+    client->buffer_sent = false;
+    return client->keys;
+}
+
+int sortClientSort(SortClient* client, int n, int priority, int timeout_ms, SortResponse* response) {
+    SortRequest request = {0, n, client->capacity, priority, timeout_ms};
+    struct iovec iov = {&request, sizeof(request)};
+    union {
+        char buffer[CMSG_SPACE(sizeof(int))];
+        struct cmsghdr align;
+    } control;
+    struct msghdr msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+
+    // The buffer travels with the first request that uses it, later requests only name the keys
+    if (!client->buffer_sent && client->memfd >= 0) {
+        request.flags |= SORT_FLAG_NEW_BUFFER;
+        memset(&control, 0, sizeof(control));
+        msg.msg_control = control.buffer;
+        msg.msg_controllen = sizeof(control.buffer);
+        struct cmsghdr* cmsg = CMSG_FIRSTHDR(&msg);
+        cmsg->cmsg_level = SOL_SOCKET;
+        cmsg->cmsg_type = SCM_RIGHTS;
+        cmsg->cmsg_len = CMSG_LEN(sizeof(int));
+        memcpy(CMSG_DATA(cmsg), &client->memfd, sizeof(int));
+    }
+
+    if (sendmsg(client->socket_fd, &msg, MSG_NOSIGNAL) != sizeof(request)) {
+        return SORT_CLIENT_CONNECTION_FAILED;
+    }
+    SortResponse reply;
+    if (recv(client->socket_fd, &reply, sizeof(reply), 0) != sizeof(reply)) {
+        return SORT_CLIENT_CONNECTION_FAILED;
+    }
+    if (request.flags & SORT_FLAG_NEW_BUFFER && reply.status != SORT_ERROR_MAP_FAILED && reply.status != SORT_ERROR_BAD_REQUEST) {
+        client->buffer_sent = true;
+    }
+    if (response != NULL) {
+        *response = reply;
+    }
+    return reply.status;
+}
+
+void sortClientClose(SortClient* client) {
+    if (client == NULL) {
+        return;
+    }
+    release_buffer(client);
+    close(client->socket_fd);
+    free(client);
+}
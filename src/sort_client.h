@@ -0,0 +1,59 @@
+/*
+ * Created by Nikos Ntokos on 24/4/24.
+ * Copyright (c) 2024, Nikos Ntokos
+ * All rights reserved.
+ */
+
+#ifndef SORT_CLIENT_H
+#define SORT_CLIENT_H
+
+#include <stdbool.h>
+#include "sort_service.h"
+
+#define SORT_CLIENT_CONNECTION_FAILED (-100) // Returned by sortClientSort when the server is unreachable
+
+typedef struct {
+    int socket_fd;
+    int memfd; // Shared buffer, -1 until the first call to sortClientKeys
+    int* keys; // Input area of the shared buffer
+    int* sorted; // Output area of the shared buffer
+    int capacity; // Keys per area
+    bool buffer_sent; // Whether the server has mapped the current buffer
+} SortClient;
+
+/**
+ * Connect to a local sort server
+ * @param socket_path The path of the server's socket, or NULL for SORT_SERVICE_DEFAULT_SOCKET
+ * @return The client, or NULL on failure
+ */
+SortClient* sortClientConnect(const char* socket_path);
+
+/**
+ * Get the input area of the shared buffer, with room for at least n keys.
+ * The caller writes its keys there directly. A larger buffer replaces the
+ * current one when needed, which discards the keys written so far
+ * @param client The client
+ * @param n The number of keys to sort next
+ * @return The input area, or NULL on failure
+ */
+int* sortClientKeys(SortClient* client, int n);
+
+/**
+ * Sort the first n keys of the input area. On success the sorted keys are in
+ * client->sorted
+ * @param client The client
+ * @param n The number of keys
+ * @param priority The task priority of the sort on the server, 0 being the highest
+ * @param timeout_ms The deadline of the sort, 0 for none
+ * @param response Where the server's response is stored, or NULL
+ * @return SORT_OK, a SortStatus error code, or SORT_CLIENT_CONNECTION_FAILED
+ */
+int sortClientSort(SortClient* client, int n, int priority, int timeout_ms, SortResponse* response);
+
+/**
+ * Disconnect from the server and release the shared buffer
+ * @param client The client
+ */
+void sortClientClose(SortClient* client);
+
+#endif //SORT_CLIENT_H
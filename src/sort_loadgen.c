@@ -0,0 +1,161 @@
+/*
+ * Created by Nikos Ntokos on 24/4/24.
+ * Copyright (c) 2024, Nikos Ntokos
+ * All rights reserved.
+ */
+
+/*
+ * Load generator for p_sort_server. Every client thread keeps one connection
+ * and one shared buffer and sends its requests back to back, so the tail
+ * latencies include queueing on the server's warm pool.
+ */
+
+#include "sort_client.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <time.h>
+
+#define DEFAULT_CLIENTS 4
+#define DEFAULT_REQUESTS 50
+#define DEFAULT_ARRAY_SIZE 100000
+#define MAX_NUMBER 1000000
+
+typedef struct {
+    const char* socket_path;
+    int id;
+    int requests;
+    int n;
+    double* latencies; // Seconds per completed request, filled by the client
+    int completed;
+    double sort_seconds; // Total time the server reported sorting
+    int failures;
+} LoadClient;
+
+static double now_seconds(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+}
+
+static int compare_ints(const void* a, const void* b) {
+    int x = *(const int*)a, y = *(const int*)b;
+    return (x > y) - (x < y);
+}
+
+static void* run_client(void* args) {
+    LoadClient* load = (LoadClient*) args;
+    SortClient* client = sortClientConnect(load->socket_path);
+    if (client == NULL) {
+        fprintf(stderr, "{run_client}: Client %d could not connect to %s\n", load->id, load->socket_path);
+        load->failures = load->requests;
+        return NULL;
+    }
+    unsigned int seed = (unsigned int)load->id + 1;
+    int* expected = (int*)malloc(load->n * sizeof(int)); // A local copy of the keys, sorted with qsort after each request
+    if (expected == NULL) {
+        fprintf(stderr, "Failed to allocate memory\n");
+        exit(EXIT_FAILURE);
+    }
+
+    for (int r = 0; r < load->requests; r++) {
+        int* keys = sortClientKeys(client, load->n);
+        if (keys == NULL) {
+            load->failures++;
+            continue;
+        }
+        for (int i = 0; i < load->n; i++) {
+            keys[i] = rand_r(&seed) % MAX_NUMBER;
+            expected[i] = keys[i];
+        }
+
+        SortResponse response;
+        double start = now_seconds();
+        int status = sortClientSort(client, load->n, 0, 0, &response);
+        double latency = now_seconds() - start;
+        if (status != SORT_OK) {
+            load->failures++;
+            continue;
+        }
+        // Sorted and a permutation of the request, so equal to the local sort of the same keys
+        qsort(expected, load->n, sizeof(int), compare_ints);
+        if (memcmp(client->sorted, expected, load->n * sizeof(int)) != 0) {
+            fprintf(stderr, "{run_client}: Client %d got a wrong result\n", load->id);
+            load->failures++;
+            continue;
+        }
+        load->latencies[load->completed++] = latency;
+        load->sort_seconds += (double)response.sort_ns / 1e9;
+    }
+    sortClientClose(client);
+    free(expected);
+    return NULL;
+}
+
+static int compare_doubles(const void* a, const void* b) {
+    double x = *(const double*)a, y = *(const double*)b;
+    return (x > y) - (x < y);
+}
+
+static double percentile(const double* sorted, int n, double p) {
+    int index = (int)(p / 100.0 * (n - 1) + 0.5);
+    return sorted[index];
+}
+
+int main(int argc, char* argv[]) {
+    const char* socket_path = argc > 1 ? argv[1] : SORT_SERVICE_DEFAULT_SOCKET;
+    int clients = argc > 2 ? atoi(argv[2]) : DEFAULT_CLIENTS;
+    int requests = argc > 3 ? atoi(argv[3]) : DEFAULT_REQUESTS;
+    int n = argc > 4 ? atoi(argv[4]) : DEFAULT_ARRAY_SIZE;
+    if (clients < 1 || requests < 1 || n < 1) {
+        fprintf(stderr, "Usage: %s [socket_path] [clients] [requests] [array_size]\n", argv[0]);
+        exit(EXIT_FAILURE);
+    }
+
+    LoadClient* loads = (LoadClient*)calloc(clients, sizeof(LoadClient));
+    double* latencies = (double*)calloc((size_t)clients * requests, sizeof(double));
+    pthread_t* threads = (pthread_t*)malloc(clients * sizeof(pthread_t));
+    if (loads == NULL || latencies == NULL || threads == NULL) {
+        fprintf(stderr, "Failed to allocate memory\n");
+        exit(EXIT_FAILURE);
+    }
+
+    double start = now_seconds();
+    for (int c = 0; c < clients; c++) {
+        loads[c] = (LoadClient){socket_path, c, requests, n, latencies + (size_t)c * requests, 0, 0, 0};
+        pthread_create(&threads[c], NULL, run_client, &loads[c]);
+    }
+    int failures = 0;
+    int total = 0; // Completed requests, the latencies of every client are packed at the front
+    double sort_seconds = 0;
+    for (int c = 0; c < clients; c++) {
+        pthread_join(threads[c], NULL);
+        failures += loads[c].failures;
+        sort_seconds += loads[c].sort_seconds;
+        memmove(latencies + total, loads[c].latencies, loads[c].completed * sizeof(double));
+        total += loads[c].completed;
+    }
+    double elapsed = now_seconds() - start;
+
+    printf("%d clients x %d requests of %d keys in %.3f s, %d failed\n", clients, requests, n, elapsed, failures);
+    if (total == 0) {
+        printf("No request completed\n");
+        free(threads);
+        free(latencies);
+        free(loads);
+        return EXIT_FAILURE;
+    }
+    qsort(latencies, total, sizeof(double), compare_doubles);
+    printf("Throughput: %.1f requests/s, %.2f Mkeys/s\n", total / elapsed, (double)total * n / elapsed / 1e6);
+    printf("Latency (ms): p50 %.3f  p90 %.3f  p99 %.3f  p99.9 %.3f  max %.3f\n",
+           percentile(latencies, total, 50) * 1e3, percentile(latencies, total, 90) * 1e3,
+           percentile(latencies, total, 99) * 1e3, percentile(latencies, total, 99.9) * 1e3,
+           latencies[total - 1] * 1e3);
+    printf("Server sort time: %.3f ms per request\n", sort_seconds / total * 1e3);
+
+    free(threads);
+    free(latencies);
+    free(loads);
+    return failures == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,272 @@
+/*
+ * Created by Nikos Ntokos on 24/4/24.
+ * Copyright (c) 2024, Nikos Ntokos
+ * All rights reserved.
+ */
+
+/*
+ * Local sort daemon. Keeps one warm ThreadPool for all its clients and serves
+ * every connection from its own thread; see sort_service.h for the protocol.
+ */
+
+#define _GNU_SOURCE
+#include "sort_service.h"
+#include "p_merge_sort.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include "verbosity.h"
+
+#define DEFAULT_MAX_THREADS 3
+#define MIN_THREADS 1
+#define LISTEN_BACKLOG 64
+
+#define VERBOSITY_LEVEL NORMAL
+
+typedef struct {
+    int fd; // Connection socket
+    ThreadPool* pool;
+    int* buffer; // Shared buffer of the client, NULL until it sends one
+    int capacity; // Keys per area of the shared buffer
+    int* scratch; // Scratch arena of the sorts, two arrays of scratch_capacity keys reused across requests
+    int scratch_capacity;
+} Connection;
+
+static volatile sig_atomic_t stop = 0;
+
+static void handle_signal(int signal) {
+    (void)signal;
+    stop = 1;
+}
+
+// Receive one request and the file descriptor attached to it, if any. Returns -1 once the client is gone
+static int receive_request(int fd, SortRequest* request, int* received_fd) {
+    union {
+        char buffer[CMSG_SPACE(sizeof(int))];
+        struct cmsghdr align;
+    } control;
+    struct iovec iov = {request, sizeof(SortRequest)};
+    struct msghdr msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control.buffer;
+    msg.msg_controllen = sizeof(control.buffer);
+
+    *received_fd = -1;
+    ssize_t size = recvmsg(fd, &msg, MSG_CMSG_CLOEXEC);
+    if (size <= 0) {
+        return -1;
+    }
+    for (struct cmsghdr* cmsg = CMSG_FIRSTHDR(&msg); cmsg != NULL; cmsg = CMSG_NXTHDR(&msg, cmsg)) {
+        if (cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_RIGHTS) {
+            memcpy(received_fd, CMSG_DATA(cmsg), sizeof(int));
+        }
+    }
+    if (size != sizeof(SortRequest)) {
+        request->flags = 0;
+        request->n = -1; // Answered as a bad request
+    }
+    return 0;
+}
+
+// Map the shared buffer a client sent in place of the previous one, takes ownership of fd
+static SortStatus map_buffer(Connection* connection, int fd, int capacity) {
+    if (capacity <= 0 || capacity > SORT_SERVICE_MAX_CAPACITY) {
+        close(fd);
+        return SORT_ERROR_BAD_REQUEST;
+    }
+    size_t size = 2 * (size_t)capacity * sizeof(int);
+
+    // A client shrinking the file later would crash the server with SIGBUS, so the file must be sealed against it
+    struct stat st;
+    int seals = fcntl(fd, F_GET_SEALS);
+    if (fstat(fd, &st) != 0 || (size_t)st.st_size < size || seals < 0 || !(seals & F_SEAL_SHRINK)) {
+        close(fd);
+        return SORT_ERROR_MAP_FAILED;
+    }
+
+    void* buffer = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd); // The mapping keeps the memory alive
+    if (buffer == MAP_FAILED) {
+        return SORT_ERROR_MAP_FAILED;
+    }
+    if (connection->buffer != NULL) {
+        munmap(connection->buffer, 2 * (size_t)connection->capacity * sizeof(int));
+    }
+    connection->buffer = (int*)buffer;
+    connection->capacity = capacity;
+    return SORT_OK;
+}
+
+static void sort_request(Connection* connection, const SortRequest* request, SortResponse* response) {
+    response->n = 0;
+    response->sort_ns = 0;
+    if (request->n < 0) {
+        response->status = SORT_ERROR_BAD_REQUEST;
+        return;
+    }
+    if (connection->buffer == NULL || request->n > connection->capacity) {
+        response->status = SORT_ERROR_NO_BUFFER;
+        return;
+    }
+    int n = request->n;
+    int* keys = connection->buffer;
+    int* sorted = connection->buffer + connection->capacity;
+    if (n > connection->scratch_capacity) {
+        free(connection->scratch);
+        connection->scratch = (int*)malloc(2 * (size_t)n * sizeof(int));
+        if (connection->scratch == NULL) {
+            fprintf(stderr, "Failed to allocate memory\n");
+            exit(EXIT_FAILURE);
+        }
+        connection->scratch_capacity = n;
+    }
+
+    struct timespec start, end;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    JobContext job;
+    initJobContext(&job, request->priority, request->timeout_ms / 1000.0);
+    if (n > 0) {
+        SortArgs args = {keys, 0, n - 1, sorted, 0, connection->pool, 0, &job,
+                         connection->scratch, connection->scratch + connection->scratch_capacity};
+        Task task = {.function = (void *(*)(void *)) p_merge_sort, .args = &args, .priority = job.priority, .job = &job};
+        if (addTaskFront(connection->pool, &task) == 0) {
+            waitForTask(connection->pool, &task);
+        } else {
+            p_merge_sort(&args);
+        }
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+
+    response->status = isJobStopped(&job) ? SORT_ERROR_CANCELLED : SORT_OK;
+    response->n = response->status == SORT_OK ? n : 0;
+    response->sort_ns = (int64_t)(end.tv_sec - start.tv_sec) * 1000000000L + (end.tv_nsec - start.tv_nsec);
+}
+
+static void* serve_connection(void* args) {
+    Connection* connection = (Connection*) args;
+    SortRequest request;
+    int received_fd;
+
+    while (receive_request(connection->fd, &request, &received_fd) == 0) {
+        SortResponse response = {SORT_OK, 0, 0};
+        if (request.flags & SORT_FLAG_NEW_BUFFER) {
+            if (received_fd < 0) {
+                response.status = SORT_ERROR_BAD_REQUEST;
+            } else {
+                response.status = map_buffer(connection, received_fd, request.capacity);
+            }
+            received_fd = -1;
+        }
+        if (received_fd >= 0) {
+            close(received_fd); // Not announced by the request
+        }
+        if (response.status == SORT_OK) {
+            sort_request(connection, &request, &response);
+        }
+        print_verbosity(DEBUG, "{serve_connection}: Sorted %d keys with status %d", request.n, response.status);
+        if (send(connection->fd, &response, sizeof(response), MSG_NOSIGNAL) != sizeof(response)) {
+            break;
+        }
+    }
+
+    if (connection->buffer != NULL) {
+        munmap(connection->buffer, 2 * (size_t)connection->capacity * sizeof(int));
+    }
+    free(connection->scratch);
+    close(connection->fd);
+    free(connection);
+    return NULL;
+}
+
+int main(int argc, char* argv[]) {
+    set_verbosity(VERBOSITY_LEVEL);
+    const char* socket_path = argc > 1 ? argv[1] : SORT_SERVICE_DEFAULT_SOCKET;
+    int max_threads = DEFAULT_MAX_THREADS;
+    if (argc > 2) {
+        max_threads = atoi(argv[2]);
+        if (max_threads < MIN_THREADS) {
+            fprintf(stderr, "{main}: Invalid number of threads\n");
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    struct sockaddr_un address;
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    if (strlen(socket_path) >= sizeof(address.sun_path)) {
+        fprintf(stderr, "{main}: Socket path too long\n");
+        exit(EXIT_FAILURE);
+    }
+    strcpy(address.sun_path, socket_path);
+
+    int listen_fd = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0);
+    if (listen_fd < 0) {
+        perror("{main}: socket");
+        exit(EXIT_FAILURE);
+    }
+    unlink(socket_path);
+    if (bind(listen_fd, (struct sockaddr*)&address, sizeof(address)) != 0 || listen(listen_fd, LISTEN_BACKLOG) != 0) {
+        perror("{main}: bind");
+        exit(EXIT_FAILURE);
+    }
+
+    // No SA_RESTART, so that a signal interrupts accept()
+    struct sigaction action;
+    memset(&action, 0, sizeof(action));
+    action.sa_handler = handle_signal;
+    sigaction(SIGINT, &action, NULL);
+    sigaction(SIGTERM, &action, NULL);
+
+    // The warm pool shared by all the connections
+    ThreadPool* pool = createElasticThreadPool(MIN_THREADS, max_threads, max_threads);
+    if (pool == NULL) {
+        exit(EXIT_FAILURE);
+    }
+    print_verbosity(NORMAL, "{main}: Listening on %s", socket_path);
+
+    while (!stop) {
+        int fd = accept4(listen_fd, NULL, NULL, SOCK_CLOEXEC);
+        if (fd < 0) {
+            if (errno != EINTR) {
+                perror("{main}: accept");
+            }
+            continue;
+        }
+        Connection* connection = (Connection*)calloc(1, sizeof(Connection));
+        if (connection == NULL) {
+            fprintf(stderr, "Failed to allocate memory\n");
+            close(fd);
+            continue;
+        }
+        connection->fd = fd;
+        connection->pool = pool;
+
+        pthread_t thread;
+        pthread_attr_t attr;
+        pthread_attr_init(&attr);
+        pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+        if (pthread_create(&thread, &attr, serve_connection, connection) != 0) {
+            fprintf(stderr, "{main}: Failed to start a connection thread\n");
+            close(fd);
+            free(connection);
+        }
+        pthread_attr_destroy(&attr);
+    }
+
+    // Connection threads may still be using the pool, so it goes away with the process
+    print_verbosity(NORMAL, "{main}: Shutting down");
+    close(listen_fd);
+    unlink(socket_path);
+    return 0;
+}
@@ -0,0 +1,48 @@
+/*
+ * Created by Nikos Ntokos on 24/4/24.
+ * Copyright (c) 2024, Nikos Ntokos
+ * All rights reserved.
+ */
+
+/*
+ * Protocol of the local sort service. Clients talk to p_sort_server over a
+ * SOCK_SEQPACKET Unix domain socket, one SortRequest answered by one
+ * SortResponse. Keys never go through the socket: every client owns a memfd
+ * holding an input area of capacity keys followed by an output area of
+ * capacity keys, passed to the server once with SCM_RIGHTS and kept mapped
+ * by the server until the client sends a new one or disconnects.
+ */
+
+#ifndef SORT_SERVICE_H
+#define SORT_SERVICE_H
+
+#include <stdint.h>
+
+#define SORT_SERVICE_DEFAULT_SOCKET "/tmp/p_sort.sock"
+#define SORT_SERVICE_MAX_CAPACITY (1 << 28) // Keys per area of a shared buffer
+
+#define SORT_FLAG_NEW_BUFFER 1 // The request carries the file descriptor of a new shared buffer
+
+typedef enum {
+    SORT_OK = 0,
+    SORT_ERROR_BAD_REQUEST = -1,
+    SORT_ERROR_NO_BUFFER = -2, // No shared buffer mapped, or too small for the request
+    SORT_ERROR_MAP_FAILED = -3,
+    SORT_ERROR_CANCELLED = -4 // The deadline of the request expired before the sort completed
+} SortStatus;
+
+typedef struct {
+    uint32_t flags;
+    int32_t n; // Number of keys to sort, at the start of the input area
+    int32_t capacity; // Keys per area of the shared buffer, with SORT_FLAG_NEW_BUFFER
+    int32_t priority; // Task priority of the sort, see NO_PRIORITIES
+    int32_t timeout_ms; // Deadline of the sort, 0 for none
+} SortRequest;
+
+typedef struct {
+    int32_t status; // A SortStatus
+    int32_t n; // Number of sorted keys written to the output area
+    int64_t sort_ns; // Time the server spent sorting
+} SortResponse;
+
+#endif //SORT_SERVICE_H
@@ -0,0 +1,141 @@
+/*
+ * Created by Nikos Ntokos on 24/4/24.
+ * Copyright (c) 2024, Nikos Ntokos
+ * All rights reserved.
+ */
+
+/*
+ * Round trip tests of the sort service. Starts the p_sort_server given on the
+ * command line on a private socket, sends it valid and invalid requests
+ * through the client library, and checks every reply. The exit code is 1 if
+ * any check failed.
+ */
+
+#define _GNU_SOURCE
+#include "sort_client.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <signal.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/wait.h>
+
+#define TEST_SEED 42
+#define ROUND_TRIP_SIZE 100003
+#define CANCELLED_SIZE (1 << 21) // Takes far longer to sort than the deadline of the request
+#define CONNECT_ATTEMPTS 200 // Attempts 10 ms apart while the server starts
+
+static int no_checks = 0;
+static int no_failures = 0;
+
+static void check(bool ok, const char* name) {
+    no_checks++;
+    if (!ok) {
+        no_failures++;
+        fprintf(stderr, "FAIL: %s\n", name);
+    }
+}
+
+static int compare_ints(const void* a, const void* b) {
+    int x = *(const int*)a, y = *(const int*)b;
+    return (x > y) - (x < y);
+}
+
+static SortClient* connect_with_retries(const char* socket_path) {
+    struct timespec pause = {0, 10000000};
+    for (int attempt = 0; attempt < CONNECT_ATTEMPTS; attempt++) {
+        SortClient* client = sortClientConnect(socket_path);
+        if (client != NULL) {
+            return client;
+        }
+        nanosleep(&pause, NULL);
+    }
+    return NULL;
+}
+
+// Fill the input area with n random keys and sort them, returns whether the reply matches qsort
+static bool round_trip(SortClient* client, int n, unsigned int* seed) {
+    int* keys = sortClientKeys(client, n);
+    int* expected = (int*)malloc((n > 0 ? n : 1) * sizeof(int));
+    if (keys == NULL || expected == NULL) {
+        free(expected);
+        return false;
+    }
+    for (int i = 0; i < n; i++) {
+        keys[i] = rand_r(seed) - RAND_MAX / 2;
+        expected[i] = keys[i];
+    }
+    SortResponse response;
+    bool ok = sortClientSort(client, n, 0, 0, &response) == SORT_OK && response.n == n;
+    qsort(expected, n, sizeof(int), compare_ints);
+    ok = ok && memcmp(client->sorted, expected, n * sizeof(int)) == 0;
+    free(expected);
+    return ok;
+}
+
+static void test_service(const char* socket_path) {
+    unsigned int seed = TEST_SEED;
+    SortClient* client = connect_with_retries(socket_path);
+    check(client != NULL, "sortClientConnect");
+    if (client == NULL) {
+        return;
+    }
+
+    check(round_trip(client, ROUND_TRIP_SIZE, &seed), "round trip with a new buffer");
+    check(round_trip(client, ROUND_TRIP_SIZE / 3, &seed), "round trip reusing the buffer");
+    check(round_trip(client, 0, &seed), "round trip of no keys");
+
+    SortResponse response;
+    check(sortClientSort(client, -1, 0, 0, &response) == SORT_ERROR_BAD_REQUEST && response.n == 0,
+          "a negative size is a bad request");
+    check(sortClientSort(client, client->capacity + 1, 0, 0, &response) == SORT_ERROR_NO_BUFFER,
+          "more keys than the buffer holds");
+
+    int* keys = sortClientKeys(client, CANCELLED_SIZE);
+    if (keys != NULL) {
+        for (int i = 0; i < CANCELLED_SIZE; i++) {
+            keys[i] = rand_r(&seed);
+        }
+    }
+    check(keys != NULL && sortClientSort(client, CANCELLED_SIZE, 1, 1, &response) == SORT_ERROR_CANCELLED
+          && response.n == 0, "an expired deadline cancels the sort");
+    check(round_trip(client, ROUND_TRIP_SIZE, &seed), "round trip after a cancelled sort");
+    sortClientClose(client);
+
+    // A client that never sent a buffer
+    SortClient* bare = connect_with_retries(socket_path);
+    check(bare != NULL && sortClientSort(bare, 10, 0, 0, &response) == SORT_ERROR_NO_BUFFER,
+          "a request without a buffer");
+    sortClientClose(bare);
+}
+
+int main(int argc, char* argv[]) {
+    if (argc < 2) {
+        fprintf(stderr, "Usage: %s path_to_p_sort_server\n", argv[0]);
+        exit(EXIT_FAILURE);
+    }
+    char socket_path[64];
+    snprintf(socket_path, sizeof(socket_path), "/tmp/p_sort_test.%ld.sock", (long)getpid());
+
+    pid_t server = fork();
+    if (server < 0) {
+        perror("{main}: fork");
+        exit(EXIT_FAILURE);
+    }
+    if (server == 0) {
+        execl(argv[1], argv[1], socket_path, "3", (char*)NULL);
+        perror("{main}: exec");
+        _exit(EXIT_FAILURE);
+    }
+
+    test_service(socket_path);
+
+    kill(server, SIGTERM);
+    int status;
+    check(waitpid(server, &status, 0) == server && WIFEXITED(status) && WEXITSTATUS(status) == 0,
+          "the server shuts down on SIGTERM");
+    unlink(socket_path);
+    printf("%d of %d checks passed\n", no_checks - no_failures, no_checks);
+    return no_failures == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}